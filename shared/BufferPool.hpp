@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace SocketLib {
+    using byte = unsigned char;
+
+    /// Where Message payloads, StreamQueue buffers and write queue blocks get their memory from.
+    /// Implementations must be thread safe, buffers are freed on whichever thread drops them last
+    class BufferAllocator {
+    public:
+        virtual ~BufferAllocator() = default;
+
+        /// \return at least size bytes aligned like operator new, or nullptr if out of memory
+        virtual byte* allocate(std::size_t size) = 0;
+
+        /// size is the one the buffer was allocated with
+        virtual void deallocate(byte* data, std::size_t size) = 0;
+
+        /// Plain operator new/delete
+        static BufferAllocator& heap();
+
+        /// Used by everything not given an allocator explicitly. A BufferPool over heap() unless replaced
+        static BufferAllocator& getDefault();
+
+        /// Replaces the default allocator. Call before creating any socket,
+        /// the allocator must outlive every buffer allocated from it
+        static void setDefault(BufferAllocator& allocator);
+    };
+
+    /// Bump allocator over a fixed region supplied by the embedder, memory is never handed back.
+    /// Meant as the upstream of a BufferPool, which recycles what it carves out of it
+    class ArenaAllocator final : public BufferAllocator {
+    public:
+        explicit ArenaAllocator(std::span<byte> memory);
+
+        byte* allocate(std::size_t size) override;
+        void deallocate(byte*, std::size_t) override {}
+
+        [[nodiscard]] std::size_t used() const {
+            return offset.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::span<byte> memory;
+        std::atomic_size_t offset = 0;
+    };
+
+    struct BufferPoolStats {
+        // Slabs taken from upstream and their total size
+        std::size_t slabs = 0;
+        std::size_t slabBytes = 0;
+        // Blocks moved between thread caches and the shared free lists
+        std::size_t refills = 0;
+        std::size_t flushes = 0;
+        // Blocks sitting in the shared free lists
+        std::size_t freeBlocks = 0;
+        // Requests larger than the biggest size class, passed straight to upstream, and the bytes still held by them
+        std::size_t oversizeAllocations = 0;
+        std::size_t oversizeBytes = 0;
+    };
+
+    /// Size classed pool, 64 bytes to 64KB in powers of two.
+    /// Each thread keeps a small cache of free blocks per class, so allocating and freeing only touches
+    /// the pool's locks when that cache runs empty or overflows. Blocks are carved from slabs taken from upstream,
+    /// which are only returned when the pool is destroyed
+    class BufferPool final : public BufferAllocator {
+    public:
+        constexpr static std::size_t MIN_BLOCK_SIZE = 64;
+        constexpr static std::size_t MAX_BLOCK_SIZE = 64 * 1024;
+        constexpr static std::size_t CLASS_COUNT = 11;
+
+        /// upstream must outlive the pool
+        explicit BufferPool(BufferAllocator& upstream = BufferAllocator::heap(), std::size_t slabSize = 256 * 1024);
+        ~BufferPool() override;
+
+        BufferPool(BufferPool const&) = delete;
+        BufferPool& operator=(BufferPool const&) = delete;
+
+        byte* allocate(std::size_t size) override;
+        void deallocate(byte* data, std::size_t size) override;
+
+        /// Returns this thread's cached blocks to the pool
+        void flushThreadCache();
+
+        [[nodiscard]] BufferPoolStats getStats() const;
+
+        /// Size class of a request, CLASS_COUNT if it is too large for any
+        [[nodiscard]] static std::size_t sizeClass(std::size_t size);
+
+        // Shared between the pool and the thread caches, which may outlive it
+        struct Central;
+
+    private:
+        std::shared_ptr<Central> central;
+    };
+
+    /// moodycamel::ConcurrentQueue traits drawing blocks from the default BufferAllocator
+    template<typename Base>
+    struct PooledQueueTraits : public Base {
+        static void* malloc(std::size_t size);
+        static void free(void* ptr);
+    };
+
+    namespace detail {
+        void* pooledQueueMalloc(std::size_t size);
+        void pooledQueueFree(void* ptr);
+    }
+
+    template<typename Base>
+    void* PooledQueueTraits<Base>::malloc(std::size_t size) {
+        return detail::pooledQueueMalloc(size);
+    }
+
+    template<typename Base>
+    void PooledQueueTraits<Base>::free(void* ptr) {
+        detail::pooledQueueFree(ptr);
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+
+namespace SocketLib::Utils {
+    constexpr static std::size_t BYTE_NOT_FOUND = std::numeric_limits<std::size_t>::max();
+
+    /// Index of the first value in bytes, BYTE_NOT_FOUND if there is none.
+    /// memchr on glibc, which vectorizes it for the CPU. Elsewhere on x86 compares 32 bytes at a time with AVX2
+    /// or 16 with SSE2, whichever the CPU has, since other libcs' memchr may not
+    std::size_t findByte(std::span<const uint8_t> bytes, uint8_t value);
+
+    /// The implementations findByte picks from, null where the CPU or build lacks them
+    namespace ByteSearch {
+        using FindFn = std::size_t (*)(uint8_t const* data, std::size_t size, uint8_t value);
+
+        /// memchr, used on glibc and for CPUs without either
+        std::size_t findPortable(uint8_t const* data, std::size_t size, uint8_t value);
+
+        [[nodiscard]] FindFn sse2();
+        [[nodiscard]] FindFn avx2();
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "LogRing.hpp"
+
+namespace SocketLib {
+
+    /// Forward declares
+    class Logger;
+
+    using WorkT = std::function<void()>;
+
+    struct CallbackExecutorStats {
+        // Tasks waiting for a thread right now
+        std::size_t queued;
+        // Most tasks that were waiting at once
+        std::size_t maxQueued;
+        // A strand's turn counts once, however many of its tasks it ran
+        uint64_t executed;
+        // Taken from another thread's queue
+        uint64_t stolen;
+        // Run by the submitting thread because every queue was full
+        uint64_t ranInline;
+    };
+
+    /// Fixed set of threads running callbacks, so sockets don't spawn a thread per event.
+    /// Every thread has its own queue and idle threads steal from the others.
+    /// Once maxQueued tasks are waiting, submit runs the task itself instead of queueing it
+    class CallbackExecutor {
+    public:
+        constinit static inline LogTag EXECUTOR_LOG_TAG{"callback_executor"};
+
+        /// \param threadCount 0 for one per core
+        CallbackExecutor(Logger& logger, std::size_t threadCount, std::size_t maxQueued);
+
+        /// Runs every task still queued, then joins the threads
+        ~CallbackExecutor();
+
+        CallbackExecutor(CallbackExecutor const&) = delete;
+        CallbackExecutor& operator=(CallbackExecutor const&) = delete;
+
+        /// Exceptions thrown by work are logged and swallowed
+        void submit(WorkT work);
+
+        [[nodiscard]] CallbackExecutorStats getStats() const;
+
+        [[nodiscard]] std::size_t getThreadCount() const {
+            return workers.size();
+        }
+
+    private:
+        friend class Strand;
+
+        struct alignas(64) Worker {
+            std::mutex mutex;
+            std::deque<WorkT> tasks;
+            std::thread thread;
+        };
+
+        Logger& logger;
+        std::size_t const maxQueued;
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic_size_t nextWorker = 0;
+
+        std::atomic_size_t queued = 0;
+        std::atomic_size_t queuedHighWater = 0;
+        std::atomic_uint64_t executed = 0;
+        std::atomic_uint64_t stolen = 0;
+        std::atomic_uint64_t ranInline = 0;
+
+        std::atomic_bool active = true;
+        std::atomic_size_t sleeping = 0;
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+
+        void run(WorkT const& work);
+        /// Runs work, logging what it throws
+        void invoke(WorkT const& work);
+
+        /// Takes a task from the worker's own queue, or steals one
+        bool tryTake(std::size_t index, WorkT& work);
+
+        void workerLoop(std::size_t index);
+    };
+
+    /// Runs posted work on an executor one task at a time, in the order it was posted.
+    /// Different strands run in parallel. Held by shared_ptr, queued work keeps it alive
+    class Strand : public std::enable_shared_from_this<Strand> {
+    public:
+        explicit Strand(CallbackExecutor& executor) : executor(executor) {}
+
+        Strand(Strand const&) = delete;
+        Strand& operator=(Strand const&) = delete;
+
+        void post(WorkT work);
+
+        /// Work posted while held waits for release
+        void hold();
+        void release();
+
+    private:
+        CallbackExecutor& executor;
+
+        std::mutex mutex;
+        std::deque<WorkT> tasks;
+        // Whether a drain is queued or running on the executor
+        bool scheduled = false;
+        bool held = false;
+
+        void drain();
+    };
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace SocketLib {
+
+    /// Identifies one connection for as long as the server runs.
+    /// Unlike a descriptor, which the kernel reuses as soon as it is closed, a handle never
+    /// refers to a different client: the generation is new for every accepted connection.
+    /// Packs generation (32 bits), worker (10 bits) and descriptor (22 bits), 0 is never a valid handle
+    struct ChannelHandle {
+        constexpr static unsigned DESCRIPTOR_BITS = 22;
+        constexpr static unsigned SHARD_BITS = 10;
+        constexpr static std::size_t MAX_SHARDS = std::size_t(1) << SHARD_BITS;
+
+        uint64_t value = 0;
+
+        constexpr ChannelHandle() = default;
+
+        constexpr explicit ChannelHandle(uint64_t value) : value(value) {}
+
+        constexpr ChannelHandle(uint32_t generation, std::size_t shard, int descriptor)
+                : value((uint64_t(generation) << (SHARD_BITS + DESCRIPTOR_BITS)) |
+                        (uint64_t(shard & (MAX_SHARDS - 1)) << DESCRIPTOR_BITS) |
+                        (uint64_t(descriptor) & ((uint64_t(1) << DESCRIPTOR_BITS) - 1))) {}
+
+        [[nodiscard]] constexpr uint32_t generation() const {
+            return uint32_t(value >> (SHARD_BITS + DESCRIPTOR_BITS));
+        }
+
+        [[nodiscard]] constexpr std::size_t shard() const {
+            return (value >> DESCRIPTOR_BITS) & (MAX_SHARDS - 1);
+        }
+
+        [[nodiscard]] constexpr int descriptor() const {
+            return int(value & ((uint64_t(1) << DESCRIPTOR_BITS) - 1));
+        }
+
+        constexpr explicit operator bool() const {
+            return value != 0;
+        }
+
+        constexpr auto operator<=>(ChannelHandle const&) const = default;
+    };
+}
+
+template<>
+struct std::hash<SocketLib::ChannelHandle> {
+    std::size_t operator()(SocketLib::ChannelHandle const& handle) const noexcept {
+        return std::hash<uint64_t>()(handle.value);
+    }
+};
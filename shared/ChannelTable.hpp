@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace SocketLib {
+
+    /// Forward declares
+    class Channel;
+
+    /// Channels indexed by descriptor in a dense table, so a lookup is an array load and needs no lock.
+    /// Chunks of slots are allocated as descriptors reach them and kept until the table is destroyed.
+    /// The table doesn't own the channels, whoever removes one retires it (see EpochReclaimer)
+    class ChannelTable {
+    public:
+        /// Sized for the process' descriptor limit
+        ChannelTable();
+        ~ChannelTable();
+
+        ChannelTable(ChannelTable const&) = delete;
+        ChannelTable& operator=(ChannelTable const&) = delete;
+
+        /// The caller must hold a pin for as long as it uses the channel
+        [[nodiscard]] Channel* find(int descriptor) const {
+            auto* chunk = findChunk(descriptor);
+            return chunk == nullptr ? nullptr : chunk[descriptor % CHUNK_SIZE].load(std::memory_order_acquire);
+        }
+
+        /// \return false if the descriptor is beyond the table or already has a channel
+        bool insert(int descriptor, Channel* channel);
+
+        /// Unlinks the channel, only one of several concurrent removes gets it
+        /// \return the channel or null if there was none
+        Channel* remove(int descriptor);
+
+        /// Invokes f with every channel, the caller must hold a pin
+        template<typename F>
+        void forEach(F&& f) const {
+            auto const highest = highestDescriptor.load(std::memory_order_acquire);
+
+            for (int descriptor = 0; descriptor <= highest; descriptor += CHUNK_SIZE) {
+                auto* chunk = findChunk(descriptor);
+                if (chunk == nullptr) {
+                    continue;
+                }
+
+                for (std::size_t i = 0; i < CHUNK_SIZE; i++) {
+                    if (auto* channel = chunk[i].load(std::memory_order_acquire)) {
+                        f(*channel);
+                    }
+                }
+            }
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return count.load(std::memory_order_relaxed);
+        }
+
+    private:
+        constexpr static int CHUNK_SIZE = 1024;
+
+        using Slot = std::atomic<Channel*>;
+
+        std::size_t chunkCount;
+        std::unique_ptr<std::atomic<Slot*>[]> chunks;
+
+        std::atomic_int highestDescriptor = -1;
+        std::atomic_size_t count = 0;
+
+        [[nodiscard]] Slot* findChunk(int descriptor) const {
+            auto const index = static_cast<std::size_t>(descriptor) / CHUNK_SIZE;
+            return descriptor < 0 || index >= chunkCount ? nullptr : chunks[index].load(std::memory_order_acquire);
+        }
+    };
+}
@@ -11,7 +11,7 @@ namespace SocketLib {
 
     class ClientSocket : public Socket {
     public:
-        constexpr static const std::string_view CLIENT_LOG_TAG = "client";
+        constinit static inline LogTag CLIENT_LOG_TAG{"client"};
 
         explicit ClientSocket(SocketHandler *socketHandler, uint32_t id, std::string const& address,
                      uint32_t port);
@@ -28,11 +28,15 @@ namespace SocketLib {
             channel->queueWrite(msg);
         }
 
+        void write(Message&& msg) {
+            channel->queueWrite(std::move(msg));
+        }
+
         void close();
 
     protected:
-        void writeLoop();
-        void readLoop();
+        /// Dispatches readiness for the channel
+        void workerLoop();
 
         void disconnectInternal(int clientDescriptor) override {
             close();
@@ -40,5 +44,8 @@ namespace SocketLib {
 
     private:
         std::unique_ptr<Channel> channel;
+
+        std::unique_ptr<EventLoop> eventLoop;
+        std::thread workerThread;
     };
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace SocketLib {
+
+    /// Epoch based reclamation for objects read without locks.
+    /// Readers pin the reclaimer while they hold pointers, writers unlink an object and retire it,
+    /// and it is destroyed once every reader that could have seen it has unpinned
+    class EpochReclaimer {
+    public:
+        class Guard {
+        public:
+            explicit Guard(EpochReclaimer& reclaimer);
+            ~Guard();
+
+            Guard(Guard const&) = delete;
+            Guard& operator=(Guard const&) = delete;
+
+        private:
+            std::atomic_uint64_t& slot;
+        };
+
+        EpochReclaimer() = default;
+        EpochReclaimer(EpochReclaimer const&) = delete;
+        EpochReclaimer& operator=(EpochReclaimer const&) = delete;
+
+        /// Runs every deleter still pending, nothing may be pinned anymore
+        ~EpochReclaimer();
+
+        /// Objects retired while the guard lives stay alive until it is destroyed.
+        /// Pins are cheap but not free, hold one per batch of lookups rather than per lookup
+        [[nodiscard]] Guard pin() {
+            return Guard(*this);
+        }
+
+        /// Schedules deleter for once no current pin can reach the object. The object must already be unlinked
+        void retire(std::function<void()> deleter);
+
+        /// Runs the deleters of objects no pin can reach anymore
+        /// \return the amount run
+        std::size_t collect();
+
+        /// Retired objects not destroyed yet
+        [[nodiscard]] std::size_t pendingCount();
+
+        /// A reclaimer for objects that don't warrant one of their own
+        static EpochReclaimer& getCommon();
+
+    private:
+        // Pins per reclaimer at once, further pins wait for a free slot
+        constexpr static std::size_t SLOT_COUNT = 128;
+
+        struct alignas(64) Slot {
+            // Epoch the pin started in, 0 if free
+            std::atomic_uint64_t epoch = 0;
+        };
+
+        struct Retired {
+            uint64_t epoch;
+            std::function<void()> deleter;
+        };
+
+        std::atomic_uint64_t epoch = 1;
+        std::array<Slot, SLOT_COUNT> slots;
+
+        std::mutex retiredMutex;
+        std::vector<Retired> retired;
+
+        std::atomic_uint64_t& acquireSlot();
+    };
+}
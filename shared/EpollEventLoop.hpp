@@ -0,0 +1,27 @@
+#pragma once
+
+#include "EventLoop.hpp"
+
+namespace SocketLib {
+
+    /// Edge triggered epoll reactor
+    class EpollEventLoop final : public EventLoop {
+    public:
+        explicit EpollEventLoop(Logger& logger);
+        ~EpollEventLoop() final;
+
+        void add(Channel& channel) final;
+
+        void remove(Channel& channel) final;
+
+        void addListener(int listenDescriptor) final;
+
+        void wakeup() final;
+
+        std::size_t wait(std::span<IoEvent> events, std::chrono::milliseconds timeout) final;
+
+    private:
+        int epollDescriptor = -1;
+        int wakeDescriptor = -1;
+    };
+}
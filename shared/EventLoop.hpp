@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "queue/concurrentqueue.h"
+#include "LogRing.hpp"
+#include "Message.hpp"
+
+namespace SocketLib {
+
+    /// Forward declares
+    class Channel;
+    class Logger;
+
+    /// Messages on their way out of a channel and the sendmsg arguments pointing at them.
+    /// Completion based loops hold a reference while the kernel reads from it, so it outlives a channel
+    /// destroyed with a send in flight
+    struct SendBatch {
+        // Dequeued from the write queue and not fully sent yet, the front may be partially sent
+        std::deque<Message> messages;
+        // Scatter-gather list over messages, reused between sends
+        std::vector<iovec> iov;
+        msghdr header{};
+    };
+
+    enum class IoBackend {
+        // Readiness based, available everywhere
+        Epoll,
+        // Completion based, batches recv/send/accept into one io_uring_enter per wait
+        // Falls back to Epoll if the kernel refuses to set up a ring
+        IoUring
+    };
+
+    struct IoEvent {
+        // Completion based backends already performed the operation, result holds what the syscall would return
+        // or -errno
+        enum class Completion : uint8_t {
+            None,
+            Received,
+            Sent,
+            Accepted
+        };
+
+        int fd = -1;
+        bool readable = false;
+        bool writable = false;
+        // peer hung up or the descriptor errored, read until EOF to find out why
+        bool hangup = false;
+
+        Completion completion = Completion::None;
+        long result = 0;
+        // Received bytes, only valid until the next wait
+        std::span<byte> data{};
+    };
+
+    /// Backend agnostic reactor.
+    /// Each loop is driven by exactly one thread, which owns every channel registered to it.
+    /// Other threads may only call add, remove, queueWritable and wakeup.
+    class EventLoop {
+    public:
+        constinit static inline LogTag EVENT_LOOP_LOG_TAG{"event_loop"};
+
+        virtual ~EventLoop() = default;
+
+        EventLoop(EventLoop const&) = delete;
+        EventLoop& operator=(EventLoop const&) = delete;
+
+        /// Starts watching the channel for read and write readiness
+        virtual void add(Channel& channel) = 0;
+
+        /// Stops watching the channel. Must be called before the descriptor is closed
+        virtual void remove(Channel& channel) = 0;
+
+        /// Starts accepting on a listening descriptor.
+        /// Readiness backends report it readable, completion backends report each accepted descriptor
+        virtual void addListener(int listenDescriptor) = 0;
+
+        /// Interrupts a blocking wait
+        virtual void wakeup() = 0;
+
+        /// Blocks until a registered descriptor is ready, the loop is woken up or the timeout expires
+        /// \return the amount of events written to events
+        virtual std::size_t wait(std::span<IoEvent> events, std::chrono::milliseconds timeout) = 0;
+
+        /// True if writes must go through submitSend instead of calling send directly
+        [[nodiscard]] virtual bool completionBased() const {
+            return false;
+        }
+
+        /// Queues an asynchronous sendmsg, completed by an IoEvent::Completion::Sent event.
+        /// Only called on the loop thread and only for completion based backends.
+        /// Sends batch->header. The loop keeps batch alive until the completion, the channel must not modify it
+        /// before the completion is reported
+        /// \return false if the send could not be queued, the loop will schedule the channel again
+        virtual bool submitSend([[maybe_unused]] Channel& channel,
+                                [[maybe_unused]] std::shared_ptr<SendBatch> const& batch) {
+            return false;
+        }
+
+        /// Asks the loop thread to flush the channel's write queue.
+        /// Thread safe, repeated calls before the loop gets to the channel are coalesced
+        void queueWritable(Channel& channel);
+
+        /// queueWritable for every channel with a single wakeup. The channels must be registered to this loop
+        void queueWritable(std::span<Channel* const> channels);
+
+        /// Invokes f with every descriptor passed to queueWritable since the last call
+        template<typename F>
+        void drainWritable(F&& f) {
+            constexpr std::size_t batchSize = 64;
+            int descriptors[batchSize];
+
+            std::size_t count;
+            while ((count = pendingWrites.try_dequeue_bulk(descriptors, batchSize)) > 0) {
+                for (std::size_t i = 0; i < count; i++) {
+                    f(descriptors[i]);
+                }
+            }
+        }
+
+    protected:
+        explicit EventLoop(Logger& logger) : logger(logger) {}
+
+        Logger& logger;
+
+        /// Lets backends attach/detach themselves, since Channel only befriends the base
+        static void setChannelLoop(Channel& channel, EventLoop* loop);
+
+        /// Schedules another flush for a descriptor whose write could not be submitted
+        void requeueWritable(int fd) {
+            pendingWrites.enqueue(fd);
+        }
+
+    private:
+        moodycamel::ConcurrentQueue<int> pendingWrites;
+    };
+}
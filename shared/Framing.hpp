@@ -0,0 +1,206 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "ByteSearch.hpp"
+#include "StreamQueue.hpp"
+
+namespace SocketLib {
+
+    /// How frames are marked in the stream. Length prefixes count only the payload after them
+    enum class FrameFormat : uint8_t {
+        // No framing, received bytes go to listenCallback as they arrive
+        None,
+        U8,
+        U16BE,
+        U16LE,
+        U32BE,
+        U32LE,
+        // Unsigned LEB128, 7 bits per byte, low bits first
+        Varint,
+        // No prefix, frames end with FramingOptions::delimiter which isn't part of the payload
+        Delimited
+    };
+
+    struct FramingOptions {
+        FrameFormat format = FrameFormat::None;
+        // Larger frames are a protocol error and close the channel, so a peer can't make us buffer without bound
+        std::size_t maxFrameSize = 1024 * 1024;
+        // For FrameFormat::Delimited
+        uint8_t delimiter = '\n';
+        // Raises SO_RCVLOWAT while a large frame is incomplete, so the kernel wakes us once it can be completed
+        // instead of for every segment. Readiness loops only, and not with dispatchListenEvents
+        bool receiveLowWatermark = true;
+    };
+
+    /// Splits a byte stream into length prefixed or delimited frames.
+    /// Frames that arrive whole in one read are handed out of that read's buffer, only the frame
+    /// straddling two reads is copied, into the pending queue
+    class FrameDecoder {
+    public:
+        constexpr static std::size_t MAX_HEADER_SIZE = 10;
+
+        enum class HeaderStatus {
+            Complete,
+            Incomplete,
+            // Longer than maxFrameSize, or a varint that doesn't fit 64 bits
+            Invalid
+        };
+
+        struct Header {
+            HeaderStatus status;
+            std::size_t headerSize = 0;
+            uint64_t payloadSize = 0;
+        };
+
+        explicit FrameDecoder(FramingOptions const& options) : options(options) {}
+
+        [[nodiscard]] FramingOptions const& getOptions() const {
+            return options;
+        }
+
+        /// Parses the length prefix at the start of bytes
+        [[nodiscard]] Header parseHeader(std::span<const uint8_t> bytes) const;
+
+        /// Calls onFrame(std::span<const uint8_t> payload) for every complete frame in pending followed by bytes.
+        /// The incomplete rest is left in pending. Payloads are only valid during the call
+        /// \return false on an invalid header, the stream can't be resynchronized after one
+        template<typename F>
+        bool decode(StreamQueue& pending, std::span<uint8_t> bytes, F&& onFrame) {
+            if (options.format == FrameFormat::Delimited) {
+                return decodeDelimited(pending, bytes, onFrame);
+            }
+
+            // Frames already queued, and the one that bytes completes
+            while (pending.queueSize() > 0) {
+                auto const header = parseHeader(headerBytes(pending, bytes));
+                if (header.status == HeaderStatus::Invalid) {
+                    return false;
+                }
+                if (header.status == HeaderStatus::Incomplete) {
+                    pending.enqueue(bytes);
+                    return true;
+                }
+
+                auto const frameSize = header.headerSize + header.payloadSize;
+                if (frameSize > pending.queueSize()) {
+                    auto const missing = frameSize - pending.queueSize();
+                    if (missing > bytes.size()) {
+                        pending.enqueue(bytes);
+                        return true;
+                    }
+
+                    pending.enqueue(bytes.subspan(0, missing));
+                    bytes = bytes.subspan(missing);
+                }
+
+                onFrame(pending.peekContiguous(frameSize).subspan(header.headerSize));
+                pending.consume(frameSize);
+            }
+
+            // Zero copy from here
+            while (!bytes.empty()) {
+                auto const header = parseHeader(bytes);
+                if (header.status == HeaderStatus::Invalid) {
+                    return false;
+                }
+
+                auto const frameSize = header.headerSize + header.payloadSize;
+                if (header.status == HeaderStatus::Incomplete || frameSize > bytes.size()) {
+                    pending.enqueue(bytes);
+                    return true;
+                }
+
+                onFrame(std::span<const uint8_t>(bytes.subspan(header.headerSize, header.payloadSize)));
+                bytes = bytes.subspan(frameSize);
+            }
+
+            return true;
+        }
+
+        /// Bytes pending lacks to complete the frame it starts, 0 if that isn't known yet.
+        /// Always 0 for delimited frames
+        [[nodiscard]] std::size_t missingBytes(StreamQueue const& pending) {
+            if (options.format == FrameFormat::Delimited || pending.queueSize() == 0) {
+                return 0;
+            }
+
+            auto const header = parseHeader(headerBytes(pending, {}));
+            if (header.status != HeaderStatus::Complete) {
+                return 0;
+            }
+
+            auto const frameSize = header.headerSize + header.payloadSize;
+            return frameSize > pending.queueSize() ? frameSize - pending.queueSize() : 0;
+        }
+
+    private:
+        FramingOptions options;
+
+        // Bytes at the front of pending known to hold no delimiter, so a long line isn't rescanned every read
+        std::size_t scanned = 0;
+
+        template<typename F>
+        bool decodeDelimited(StreamQueue& pending, std::span<uint8_t> bytes, F& onFrame) {
+            while (pending.queueSize() > 0) {
+                auto end = pending.find(options.delimiter, scanned);
+
+                if (end == Utils::BYTE_NOT_FOUND) {
+                    auto const inBytes = Utils::findByte(bytes, options.delimiter);
+                    if (inBytes == Utils::BYTE_NOT_FOUND) {
+                        return keepPartialLine(pending, bytes);
+                    }
+
+                    // Completes the line started in an earlier read
+                    pending.enqueue(bytes.subspan(0, inBytes + 1));
+                    bytes = bytes.subspan(inBytes + 1);
+                    end = pending.queueSize() - 1;
+                }
+
+                if (end > options.maxFrameSize) {
+                    return false;
+                }
+
+                onFrame(pending.peekContiguous(end + 1).first(end));
+                pending.consume(end + 1);
+                scanned = 0;
+            }
+
+            // Zero copy from here
+            while (!bytes.empty()) {
+                auto const end = Utils::findByte(bytes, options.delimiter);
+                if (end == Utils::BYTE_NOT_FOUND) {
+                    return keepPartialLine(pending, bytes);
+                }
+
+                if (end > options.maxFrameSize) {
+                    return false;
+                }
+
+                onFrame(std::span<const uint8_t>(bytes.first(end)));
+                bytes = bytes.subspan(end + 1);
+            }
+
+            return true;
+        }
+
+        /// Queues bytes holding no delimiter behind the pending ones
+        bool keepPartialLine(StreamQueue& pending, std::span<uint8_t> bytes) {
+            if (pending.queueSize() + bytes.size() > options.maxFrameSize) {
+                return false;
+            }
+
+            pending.enqueue(bytes);
+            scanned = pending.queueSize();
+            return true;
+        }
+
+        // Enough of pending followed by bytes to hold any header, copied since it may wrap around the queue
+        std::array<uint8_t, MAX_HEADER_SIZE> headerScratch{};
+
+        std::span<const uint8_t> headerBytes(StreamQueue const& pending, std::span<const uint8_t> bytes);
+    };
+}
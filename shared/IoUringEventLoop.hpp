@@ -0,0 +1,155 @@
+#pragma once
+
+#if __has_include(<linux/io_uring.h>) && !defined(SOCKETLIB_NO_IO_URING)
+#define SOCKETLIB_IO_URING
+#endif
+
+#ifdef SOCKETLIB_IO_URING
+
+#include "EventLoop.hpp"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// linux/io_uring.h pulls in linux/fs.h, whose BLOCK_SIZE macro breaks moodycamel's queues
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace SocketLib {
+
+    /// Completion based reactor on top of raw io_uring syscalls.
+    /// Every recv/send/accept becomes an SQE, and all SQEs queued while dispatching are submitted
+    /// together by the io_uring_enter that waits for the next completions.
+    ///
+    /// Where the kernel allows it (5.19+/6.0+) accepts and receives are multishot, so one SQE keeps
+    /// producing completions, and receives pick their buffer from a ring shared by every channel on the loop,
+    /// so idle channels don't pin a buffer.
+    class IoUringEventLoop final : public EventLoop {
+    public:
+        /// Throws if the kernel refuses to create a ring or lacks the features we rely on
+        /// \param bufferSize size of each receive buffer
+        /// \param entries submission queue size
+        /// \param providedBuffers receive buffers shared by the loop's channels, power of two up to 32768
+        explicit IoUringEventLoop(Logger& logger, uint32_t bufferSize, uint32_t entries = 256,
+                                  uint16_t providedBuffers = 1024);
+        ~IoUringEventLoop() final;
+
+        void add(Channel& channel) final;
+
+        void remove(Channel& channel) final;
+
+        void addListener(int listenDescriptor) final;
+
+        void wakeup() final;
+
+        std::size_t wait(std::span<IoEvent> events, std::chrono::milliseconds timeout) final;
+
+        [[nodiscard]] bool completionBased() const final {
+            return true;
+        }
+
+        bool submitSend(Channel& channel, std::shared_ptr<SendBatch> const& batch) final;
+
+    private:
+        enum class Operation : uint64_t {
+            Recv = 1,
+            Send = 2,
+            Accept = 3,
+            Wake = 4,
+            Cancel = 5
+        };
+
+        struct alignas(8) Registration {
+            int fd;
+            bool listener;
+            bool removed = false;
+            // Kernel may still write into buffer until every operation has completed
+            uint32_t inFlight = 0;
+            // Only used when the kernel can't select from the provided buffer ring
+            std::unique_ptr<byte[]> buffer;
+            // Read by the send in flight, the channel may be gone before it completes
+            std::shared_ptr<SendBatch> sendBatch;
+        };
+
+        struct Command {
+            int fd;
+            bool listener;
+            bool add;
+        };
+
+        uint32_t const bufferSize;
+
+        int ringDescriptor = -1;
+        int wakeDescriptor = -1;
+        uint64_t wakeCounter = 0;
+        bool wakeArmed = false;
+
+        // Ring mappings
+        void* sqRing = nullptr;
+        std::size_t sqRingSize = 0;
+        void* cqRing = nullptr;
+        std::size_t cqRingSize = 0;
+        io_uring_sqe* sqes = nullptr;
+        std::size_t sqesSize = 0;
+
+        unsigned* sqHead = nullptr;
+        unsigned* sqTail = nullptr;
+        unsigned sqMask = 0;
+        unsigned sqEntries = 0;
+        unsigned* sqArray = nullptr;
+
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned cqMask = 0;
+        io_uring_cqe* cqes = nullptr;
+
+        // Provided buffer ring, null if the kernel can't register one
+        io_uring_buf_ring* bufferRing = nullptr;
+        std::size_t bufferRingSize = 0;
+        std::unique_ptr<byte[]> providedBufferStorage;
+        uint16_t providedBufferCount = 0;
+        uint16_t bufferRingTail = 0;
+        // Handed out by the last wait, recycled at the start of the next
+        std::vector<uint16_t> consumedBuffers;
+
+        bool multishotRecv = false;
+        bool multishotAccept = true;
+
+        // Only touched by the loop thread
+        std::unordered_map<int, std::unique_ptr<Registration>> registrations;
+        std::unordered_map<Registration*, std::unique_ptr<Registration>> retired;
+        // Recvs and accepts to arm again on the next wait, the submission queue was full or they ended
+        std::vector<Registration*> pendingArms;
+        // Retired registrations whose cancel didn't fit the submission queue, retried on the next wait
+        std::vector<Registration*> pendingCancels;
+        std::vector<int> deferredWrites;
+
+        // add/remove may come from any thread and have to be applied in order
+        std::mutex commandsMutex;
+        std::vector<Command> commands;
+        std::vector<Command> commandsBack;
+
+        io_uring_sqe* getSqe();
+        void submit(unsigned minComplete, std::chrono::milliseconds timeout);
+
+        void applyCommands();
+
+        void setupBufferRing(uint16_t count);
+        void recycleBuffers();
+
+        void armRecv(Registration& registration);
+        void armAccept(Registration& registration);
+        void armWake();
+        void cancel(Registration& registration);
+
+        void retire(std::unique_ptr<Registration> registration);
+        void release(Registration& registration);
+
+        void unmapRing();
+    };
+}
+
+#endif
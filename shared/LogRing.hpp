@@ -0,0 +1,237 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#include <fmt/core.h>
+
+namespace SocketLib {
+
+    /// Single producer, single consumer ring of variable sized records.
+    /// The producer never blocks or allocates, a record that doesn't fit is refused
+    class LogRing {
+    public:
+        constexpr static std::size_t CAPACITY = 64 * 1024;
+        constexpr static std::size_t ALIGNMENT = 8;
+
+        LogRing() : buffer(std::make_unique<std::byte[]>(CAPACITY)) {}
+
+        LogRing(LogRing const&) = delete;
+        LogRing& operator=(LogRing const&) = delete;
+
+        /// Producer only. Space for a record of size bytes, nullptr if the ring is full.
+        /// The record starts with its uint32_t size and is published by commit
+        std::byte* reserve(std::size_t size);
+        void commit();
+
+        /// Consumer only. Calls f with every published record, returns how many
+        template<typename F>
+        std::size_t drain(F&& f) {
+            auto const end = tail.load(std::memory_order_acquire);
+            auto position = head.load(std::memory_order_relaxed);
+
+            std::size_t count = 0;
+            while (position != end) {
+                auto const offset = position % CAPACITY;
+
+                uint32_t size;
+                std::memcpy(&size, buffer.get() + offset, sizeof(size));
+
+                // Padding up to the end of the buffer, the record is at the start
+                if (size == 0) {
+                    position += CAPACITY - offset;
+                    continue;
+                }
+
+                f(std::span<std::byte const>(buffer.get() + offset, size));
+                position += alignUp(size);
+                count++;
+            }
+
+            head.store(position, std::memory_order_release);
+            return count;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+
+        /// Set once the producing thread exits, the consumer drops the ring after draining it
+        std::atomic_bool abandoned = false;
+
+    private:
+        constexpr static std::size_t alignUp(std::size_t size) {
+            return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        }
+
+        std::unique_ptr<std::byte[]> buffer;
+
+        alignas(64) std::atomic_size_t head = 0;
+        alignas(64) std::atomic_size_t tail = 0;
+
+        // Producer side, the last head it saw and the reservation waiting for commit
+        std::size_t cachedHead = 0;
+        std::size_t pending = 0;
+    };
+
+    enum class LoggerLevel;
+
+    /// Prefix of a deferred log record, the encoded arguments follow it
+    struct LogRecordHeader {
+        using FormatFn = std::string (*)(std::string_view format, std::span<std::byte const> arguments);
+
+        uint32_t size;
+        uint16_t tag;
+        LoggerLevel level;
+        // system_clock, nanoseconds
+        int64_t timestamp;
+        // Rebuilds the arguments and formats them, one per argument list
+        FormatFn format;
+        // Points into the binary, format strings are literals
+        char const* formatString;
+        std::size_t formatLength;
+    };
+
+    namespace detail {
+        /// Tags get an id the first time they're logged, ids are never reused. Lock free for tags seen before,
+        /// adding a new one takes a lock once. Past MAX_LOG_TAGS every new tag shares MAX_LOG_TAGS
+        uint16_t internLogTag(std::string_view tag);
+        /// Lock free
+        std::string_view logTagName(uint16_t id);
+
+        constexpr std::size_t MAX_LOG_TAGS = 4096;
+
+        template<typename T>
+        concept DeferredString = std::is_convertible_v<T const&, std::string_view>;
+
+        template<typename T>
+        concept DeferredValue = !DeferredString<T> &&
+                                (std::is_arithmetic_v<std::decay_t<T>> || std::is_enum_v<std::decay_t<T>> ||
+                                 std::is_pointer_v<std::decay_t<T>>);
+
+        /// Arguments that can be copied into a record and formatted later, anything else is formatted eagerly
+        template<typename T>
+        concept Deferrable = DeferredString<std::remove_cvref_t<T>> || DeferredValue<std::remove_cvref_t<T>>;
+
+        /// What an argument is decoded as, strings point into the record
+        template<typename T>
+        using DeferredStorage = std::conditional_t<DeferredString<std::remove_cvref_t<T>>, std::string_view, std::decay_t<T>>;
+
+        template<typename T>
+        std::size_t deferredSize(T const& value) {
+            if constexpr (DeferredString<T>) {
+                return sizeof(uint32_t) + std::string_view(value).size();
+            } else {
+                return sizeof(std::decay_t<T>);
+            }
+        }
+
+        template<typename T>
+        std::byte* encodeDeferred(std::byte* out, T const& value) {
+            if constexpr (DeferredString<T>) {
+                std::string_view const string(value);
+                auto const length = static_cast<uint32_t>(string.size());
+                std::memcpy(out, &length, sizeof(length));
+                std::memcpy(out + sizeof(length), string.data(), string.size());
+                return out + sizeof(length) + string.size();
+            } else {
+                std::decay_t<T> const copy = value;
+                std::memcpy(out, &copy, sizeof(copy));
+                return out + sizeof(copy);
+            }
+        }
+
+        template<typename S>
+        S decodeDeferred(std::byte const*& in) {
+            if constexpr (std::is_same_v<S, std::string_view>) {
+                uint32_t length;
+                std::memcpy(&length, in, sizeof(length));
+                std::string_view const string(reinterpret_cast<char const*>(in + sizeof(length)), length);
+                in += sizeof(length) + length;
+                return string;
+            } else {
+                S value;
+                std::memcpy(&value, in, sizeof(value));
+                in += sizeof(value);
+                return value;
+            }
+        }
+
+        template<typename... S>
+        std::string formatDeferred(std::string_view format, std::span<std::byte const> arguments) {
+            [[maybe_unused]] auto const* cursor = arguments.data();
+            // Braced initialization evaluates left to right, matching the encoding order
+            std::tuple<S...> values{decodeDeferred<S>(cursor)...};
+
+            return std::apply([format](auto const&... args) {
+                return fmt::vformat(format, fmt::make_format_args(args...));
+            }, values);
+        }
+    }
+
+    /// A tag that looks its id up once, so log calls through it check their level with a relaxed load.
+    /// Meant for constinit statics
+    class LogTag {
+    public:
+        constexpr explicit LogTag(std::string_view name) : name(name) {}
+
+        LogTag(LogTag const&) = delete;
+        LogTag& operator=(LogTag const&) = delete;
+
+        [[nodiscard]] constexpr std::string_view getName() const {
+            return name;
+        }
+
+        [[nodiscard]] constexpr explicit(false) operator std::string_view() const {
+            return name;
+        }
+
+        [[nodiscard]] uint16_t getId() const {
+            auto const cached = id.load(std::memory_order_relaxed);
+            if (cached != UNRESOLVED) {
+                return static_cast<uint16_t>(cached);
+            }
+
+            // Racing threads resolve the same id
+            auto const resolved = detail::internLogTag(name);
+            id.store(resolved, std::memory_order_relaxed);
+            return resolved;
+        }
+
+    private:
+        constexpr static uint32_t UNRESOLVED = ~0u;
+
+        std::string_view name;
+        mutable std::atomic_uint32_t id = UNRESOLVED;
+    };
+
+    /// What log calls take as their tag, a LogTag or a plain string looked up on every call
+    class LogTagView {
+    public:
+        constexpr LogTagView(LogTag const& tag) : name(tag.getName()), tag(&tag) {}
+        constexpr LogTagView(std::string_view name) : name(name) {}
+        constexpr LogTagView(char const* name) : name(name) {}
+        LogTagView(std::string const& name) : name(name) {}
+
+        [[nodiscard]] constexpr std::string_view getName() const {
+            return name;
+        }
+
+        [[nodiscard]] uint16_t getId() const {
+            return tag != nullptr ? tag->getId() : detail::internLogTag(name);
+        }
+
+    private:
+        std::string_view name;
+        LogTag const* tag = nullptr;
+    };
+}
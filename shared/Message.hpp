@@ -1,23 +1,45 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <cstring>
 #include <string>
 #include <span>
 #include <vector>
 
+#include "BufferPool.hpp"
+
 // Heavily inspired from https://github.com/shuai132/SocketPP/blob/7741e80603b3a7ee06ee7ebbc74488935f2de41c/socketpp/RawMsg.h
 // Please don't mind, good library inspiration
 
 namespace SocketLib {
     using byte = unsigned char;
 
+    /// Header of a buffer shared by every copy of a shared Message, the bytes follow it in the same allocation
+    struct SharedMessageBuffer {
+        std::atomic_size_t refs;
+        BufferAllocator* allocator;
+        // Of the whole allocation, header included
+        size_t size;
+
+        [[nodiscard]] byte* bytes() {
+            return reinterpret_cast<byte*>(this + 1);
+        }
+
+        static SharedMessageBuffer* allocate(size_t len, BufferAllocator& allocator);
+        void release();
+    };
+
     struct Message {
 
         // Please avoid
         explicit Message() = default;
 
-        constexpr void init(size_t len) {
+        /// Payloads up to this size are stored in the message itself instead of the heap
+        constexpr static size_t INLINE_CAPACITY = 64;
+
+        /// Payloads larger than INLINE_CAPACITY are taken from allocator, BufferAllocator::getDefault() if null
+        void init(size_t len, BufferAllocator* allocator = nullptr) {
             if (len == 0) {
                 _len = 0;
                 _data = nullptr;
@@ -25,51 +47,66 @@ namespace SocketLib {
             }
 
             _len = len;
-            _data = new byte[len];
+            if (len <= INLINE_CAPACITY) {
+                _data = _inline;
+                return;
+            }
+
+            allocateHeap(allocator != nullptr ? *allocator : BufferAllocator::getDefault());
         }
 
-        constexpr void init(const byte* data, size_t len) {
+        void init(const byte* data, size_t len, BufferAllocator* allocator = nullptr) {
             if (data == nullptr || len == 0) {
                 _len = 0;
                 _data = nullptr;
                 return;
             }
 
-            _len = len;
-            _data = new byte[len];
-
+            init(len, allocator);
             memcpy(_data, data, len);
         }
 
-        constexpr explicit Message(size_t len) {
+        explicit Message(size_t len) {
             init(len);
         }
 
-        constexpr explicit Message(const byte* data, size_t len) {
+        explicit Message(size_t len, BufferAllocator& allocator) {
+            init(len, &allocator);
+        }
+
+        explicit Message(std::span<const byte> data, BufferAllocator& allocator) {
+            init(data.data(), data.size(), &allocator);
+        }
+
+        explicit Message(const byte* data, size_t len) {
             init(data, len);
         }
 
-        constexpr explicit Message(std::span<byte> data) {
+        explicit Message(std::span<byte> data) {
             init(data.data(), data.size());
         }
         explicit Message(std::vector<byte> data) {
             init(data.data(), data.size());
         }
 
-        constexpr explicit Message(const std::string_view data) {
+        explicit Message(const std::string_view data) {
             init(reinterpret_cast<const byte *>(data.data()), data.length());
         }
 
-        constexpr Message(const Message& msg) {
-            init(msg._data, msg._len);
+        /// An immutable message whose copies all reference the same buffer, freed by the last copy.
+        /// Queueing it to any number of channels costs one allocation
+        static Message makeShared(std::span<const byte> data, BufferAllocator& allocator = BufferAllocator::getDefault());
+
+        Message(const Message& msg) {
+            copy(msg);
         }
 
-        constexpr Message& operator=(const Message& msg) {
+        Message& operator=(const Message& msg) {
             if (&msg == this)
                 return *this;
 
-            delete[] _data;
-            init(msg._data, msg._len);
+            free();
+            copy(msg);
             return *this;
         }
 
@@ -77,11 +114,21 @@ namespace SocketLib {
             if (&other == this)
                 return *this;
 
-            _len = other._len;
-            delete[] _data;
+            free();
 
-            _data = other._data;
+            _len = other._len;
+            _shared = other._shared;
+            _allocator = other._allocator;
+            if (other.isInline()) {
+                memcpy(_inline, other._inline, _len);
+                _data = _inline;
+            } else {
+                _data = other._data;
+            }
+            other._len = 0;
             other._data = nullptr;
+            other._shared = nullptr;
+            other._allocator = nullptr;
 
             return *this;
         }
@@ -94,10 +141,27 @@ namespace SocketLib {
             return move(other);
         }
 
-        constexpr ~Message() {
-            delete[] _data;
+        ~Message() {
+            free();
         }
 
+        /// Turns this into a shared message, see makeShared. Copies once unless it already is one.
+        /// Inline messages are left as they are since copying them doesn't allocate anyway
+        Message& share();
+
+        /// A copy whose own copies won't allocate: this if it is shared or inline, a new shared message otherwise
+        [[nodiscard]] Message toShared() const;
+
+        [[nodiscard]] bool isShared() const {
+            return _shared != nullptr;
+        }
+
+        [[nodiscard]] constexpr bool isInline() const {
+            return _data == _inline;
+        }
+
+        /// Must not be written to if the message is shared.
+        /// Points into the message itself for inline payloads, so moving the message invalidates it
         [[nodiscard]] byte* data() const {
             return _data;
         }
@@ -123,8 +187,43 @@ namespace SocketLib {
         }
 
     private:
+        // Hands its buffer over as a shared message
+        friend class MessageBuilder;
+
         size_t _len = 0;
         byte* _data = nullptr;
+        // Owner of _data if shared, otherwise _data is ours
+        SharedMessageBuffer* _shared = nullptr;
+        // Where _data came from if it is ours and not inline
+        BufferAllocator* _allocator = nullptr;
+        // Small payloads live here, _data points at it then. Deliberately not zeroed
+        byte _inline[INLINE_CAPACITY];
+
+        void copy(const Message& msg) {
+            if (msg._shared == nullptr) {
+                init(msg._data, msg._len, msg._allocator);
+                return;
+            }
+
+            msg._shared->refs.fetch_add(1, std::memory_order_relaxed);
+            _shared = msg._shared;
+            _data = msg._data;
+            _len = msg._len;
+        }
+
+        void free() {
+            if (_shared != nullptr) {
+                _shared->release();
+                _shared = nullptr;
+            } else if (_allocator != nullptr) {
+                _allocator->deallocate(_data, _len);
+                _allocator = nullptr;
+            }
+            _data = nullptr;
+        }
+
+        /// Points _data at _len bytes from allocator, throws std::bad_alloc if it is out of memory
+        void allocateHeap(BufferAllocator& allocator);
 
 
     };
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include "BufferPool.hpp"
+#include "Framing.hpp"
+#include "Message.hpp"
+
+namespace SocketLib {
+
+    /// Serializes an outbound message straight into a pooled buffer that grows as needed.
+    /// build hands the buffer over as a shared Message without copying it, so queueing it to one channel or
+    /// broadcasting it to many never copies the payload either. The builder is empty and reusable afterwards
+    class MessageBuilder {
+    public:
+        constexpr static std::size_t DEFAULT_CAPACITY = 256;
+
+        explicit MessageBuilder(std::size_t capacity = DEFAULT_CAPACITY,
+                                BufferAllocator &allocator = BufferAllocator::getDefault())
+                : allocator(&allocator), initialCapacity(capacity) {}
+
+        MessageBuilder(MessageBuilder &&other) noexcept
+                : allocator(other.allocator),
+                  initialCapacity(other.initialCapacity),
+                  buffer(std::exchange(other.buffer, nullptr)),
+                  capacity(std::exchange(other.capacity, 0)),
+                  size(std::exchange(other.size, 0)) {}
+
+        MessageBuilder(MessageBuilder const &) = delete;
+        MessageBuilder &operator=(MessageBuilder const &) = delete;
+        MessageBuilder &operator=(MessageBuilder &&) = delete;
+
+        ~MessageBuilder() {
+            release();
+        }
+
+        /// Bytes written so far, without a prefix added by build
+        [[nodiscard]] std::span<byte> written() const {
+            if (buffer == nullptr) {
+                return {};
+            }
+            return {payload(), size};
+        }
+
+        [[nodiscard]] std::size_t length() const {
+            return size;
+        }
+
+        /// Drops everything written, keeping the buffer
+        void clear() {
+            size = 0;
+        }
+
+        /// Makes room for n more bytes, so the following writes don't grow the buffer
+        void reserve(std::size_t n) {
+            if (HEADROOM + size + n > capacity) {
+                grow(size + n);
+            }
+        }
+
+        /// n writable bytes at the end, zeroed. Fill them in later through written(), e.g. a length or checksum
+        /// only known once the rest is written
+        /// \return their position
+        std::size_t skip(std::size_t n) {
+            reserve(n);
+            std::memset(payload() + size, 0, n);
+            size += n;
+            return size - n;
+        }
+
+        template<std::unsigned_integral T, std::endian order>
+        MessageBuilder &write(T value) {
+            reserve(sizeof(T));
+            writeAt<T, order>(size, value);
+            size += sizeof(T);
+            return *this;
+        }
+
+        /// Overwrites bytes already written, usually ones set aside by skip
+        template<std::unsigned_integral T, std::endian order>
+        void writeAt(std::size_t position, T value) {
+            store<T, order>(payload() + position, value);
+        }
+
+        MessageBuilder &writeU8(uint8_t value) {
+            return write<uint8_t, std::endian::little>(value);
+        }
+
+        MessageBuilder &writeU16LE(uint16_t value) {
+            return write<uint16_t, std::endian::little>(value);
+        }
+
+        MessageBuilder &writeU16BE(uint16_t value) {
+            return write<uint16_t, std::endian::big>(value);
+        }
+
+        MessageBuilder &writeU32LE(uint32_t value) {
+            return write<uint32_t, std::endian::little>(value);
+        }
+
+        MessageBuilder &writeU32BE(uint32_t value) {
+            return write<uint32_t, std::endian::big>(value);
+        }
+
+        MessageBuilder &writeU64LE(uint64_t value) {
+            return write<uint64_t, std::endian::little>(value);
+        }
+
+        MessageBuilder &writeU64BE(uint64_t value) {
+            return write<uint64_t, std::endian::big>(value);
+        }
+
+        /// Unsigned LEB128, 7 bits per byte, low bits first
+        MessageBuilder &writeVarint(uint64_t value) {
+            reserve(FrameDecoder::MAX_HEADER_SIZE);
+            size += encodeVarint(value, payload() + size);
+            return *this;
+        }
+
+        MessageBuilder &writeBytes(std::span<const byte> bytes) {
+            if (bytes.empty()) {
+                return *this;
+            }
+
+            reserve(bytes.size());
+            std::memcpy(payload() + size, bytes.data(), bytes.size());
+            size += bytes.size();
+            return *this;
+        }
+
+        MessageBuilder &writeString(std::string_view string) {
+            return writeBytes({reinterpret_cast<byte const *>(string.data()), string.size()});
+        }
+
+        /// fmt::format_to straight into the buffer, growing it and formatting again only if the text didn't fit
+        template<typename... TArgs>
+        MessageBuilder &format(fmt::format_string<TArgs...> format, TArgs &&... args) {
+            reserve(0);
+            auto const available = capacity - HEADROOM - size;
+            auto const arguments = fmt::make_format_args(args...);
+
+            auto const result = fmt::vformat_to_n(reinterpret_cast<char *>(payload() + size), available, format,
+                                                  arguments);
+            if (result.size > available) {
+                reserve(result.size);
+                fmt::vformat_to(reinterpret_cast<char *>(payload() + size), format, arguments);
+            }
+
+            size += result.size;
+            return *this;
+        }
+
+        /// Everything written as one message, without copying it. Empty if nothing was written
+        Message build() {
+            return take(HEADROOM);
+        }
+
+        /// Everything written as one frame of framing: a length prefix is put in the room kept in front
+        /// of the payload, or the delimiter appended, so this doesn't copy either.
+        /// Throws std::length_error if the payload is larger than framing allows
+        Message build(FramingOptions const &framing);
+
+    private:
+        // Kept free in front of the payload for the longest length prefix
+        constexpr static std::size_t HEADROOM = FrameDecoder::MAX_HEADER_SIZE;
+
+        BufferAllocator *allocator;
+        std::size_t initialCapacity;
+
+        // A SharedMessageBuffer header, HEADROOM bytes, then the payload. Allocated on the first write
+        SharedMessageBuffer *buffer = nullptr;
+        // Of the bytes after the header
+        std::size_t capacity = 0;
+        std::size_t size = 0;
+
+        [[nodiscard]] byte *payload() const {
+            return buffer->bytes() + HEADROOM;
+        }
+
+        /// Room for needed payload bytes, keeping those written so far
+        void grow(std::size_t needed);
+
+        /// Hands the buffer over as a message starting at offset bytes after the header
+        Message take(std::size_t offset);
+
+        void release();
+
+        template<std::unsigned_integral T, std::endian order>
+        static void store(byte *out, T value) {
+            for (std::size_t i = 0; i < sizeof(T); i++) {
+                auto const shift = order == std::endian::big ? (sizeof(T) - 1 - i) * 8 : i * 8;
+                out[i] = static_cast<byte>(value >> shift);
+            }
+        }
+
+        /// The length prefix of framing for the payload written so far
+        /// \return its size
+        std::size_t encodePrefix(FrameFormat format, std::span<byte, HEADROOM> out) const;
+
+        static std::size_t encodeVarint(uint64_t value, byte *out) {
+            std::size_t count = 0;
+            do {
+                auto const bits = static_cast<byte>(value & 0x7F);
+                value >>= 7;
+                out[count++] = value != 0 ? bits | 0x80 : bits;
+            } while (value != 0);
+            return count;
+        }
+    };
+}
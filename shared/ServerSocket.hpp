@@ -2,9 +2,12 @@
 
 #include "Socket.hpp"
 #include "SocketUtil.hpp"
+#include <string>
 #include <unordered_map>
 #include <shared_mutex>
 #include "ExclusiveSharedMutex.h"
+#include "ChannelTable.hpp"
+#include "EpochReclaimer.hpp"
 
 #include "SocketLogger.hpp"
 #include "fmt/format.h"
@@ -13,7 +16,7 @@ namespace SocketLib {
 
     class ServerSocket : public Socket {
     public:
-        constexpr static const std::string_view SERVER_LOG_TAG = "server";
+        constinit static inline LogTag SERVER_LOG_TAG{"server"};
 
         explicit ServerSocket(SocketHandler *socketHandler, uint32_t id, uint32_t port)
                 : Socket(socketHandler, id, std::nullopt, port) {}
@@ -34,6 +37,13 @@ namespace SocketLib {
         /// Disconnects the client
         void closeClient(int clientDescriptor);
 
+        /// Disconnects the client
+        /// \return false if it already disconnected
+        bool closeClient(ChannelHandle handle);
+
+        /// Whether the client the handle was issued for is still connected
+        [[nodiscard]] bool isConnected(ChannelHandle handle);
+
         sockaddr_storage getPeerName(int clientDescriptor);
 
         HostPort getPeerAddress(int clientDescriptor);
@@ -44,40 +54,172 @@ namespace SocketLib {
         void getHostByName() {};
 
         /// This will write to the clientDescriptor
-        /// Note: This is slower than Channel.queueWrite because it grabs a lock
+        /// Note: This is slower than Channel.queueWrite because it has to look the channel up
         /// \param clientDescriptor
         /// \param msg
         void write(int clientDescriptor, const Message &msg);
 
-        [[nodiscard]] std::unordered_map<int, std::unique_ptr<Channel>> const &getClients() const {
-            return clientDescriptors;
+        /// Looks the channel up without locks and writes to it.
+        /// Unlike a descriptor, a handle never reaches a different client that reused it
+        /// \return false if the client disconnected or the message was dropped
+        bool write(ChannelHandle handle, const Message &msg);
+
+        /// Invokes f with the channel if it is still connected. It stays valid until f returns, even if closed meanwhile
+        /// \return false if the client disconnected
+        template<typename F>
+        bool withChannel(ChannelHandle handle, F&& f) {
+            auto guard = reclaimer.pin();
+            auto* channel = resolve(handle);
+            if (channel == nullptr) {
+                return false;
+            }
+
+            f(*channel);
+            return true;
+        }
+
+        /// Invokes f with every connected channel.
+        /// Channels closed meanwhile, even by f, stay valid until forEachClient returns
+        template<typename F>
+        void forEachClient(F&& f) {
+            auto guard = reclaimer.pin();
+            for (auto &shard: shards) {
+                shard->channels.forEach(f);
+            }
+        }
+
+        /// Queues msg to every connected channel filter accepts.
+        /// The payload is shared by every recipient instead of copied, and each worker is woken once.
+        /// Never waits on a full channel, even under WriteOverflowPolicy::Block, since it holds a reclaimer pin
+        /// \return the amount of channels it was queued to
+        template<typename F>
+        std::size_t broadcast(const Message &msg, F&& filter) {
+            auto const shared = msg.toShared();
+            std::vector<Channel*> recipients;
+            std::size_t queued = 0;
+
+            auto guard = reclaimer.pin();
+            for (auto &shard: shards) {
+                shard->channels.forEach([&](Channel &channel) {
+                    if (filter(channel) && channel.enqueueWrite(shared, false)) {
+                        recipients.push_back(&channel);
+                    }
+                });
+
+                shard->eventLoop->queueWritable(recipients);
+                queued += recipients.size();
+                recipients.clear();
+            }
+
+            return queued;
         }
 
-        // readThreads = workerThreadCount
-        // writeThreads = workerThreadCount
+        std::size_t broadcast(const Message &msg) {
+            return broadcast(msg, [](Channel const&) { return true; });
+        }
+
+        /// Adds the client to a named group, created on first use.
+        /// Clients leave every group when they disconnect
+        void joinGroup(std::string const& group, int clientDescriptor);
+
+        void leaveGroup(std::string const& group, int clientDescriptor);
+
+        /// broadcast to the members of a group
+        /// \return the amount of channels it was queued to
+        std::size_t multicast(std::string const& group, const Message &msg);
+
+        [[nodiscard]] std::size_t getGroupSize(std::string const& group);
+
+        [[nodiscard]] std::size_t getClientCount();
+
+        // Each worker thread drives its own event loop, clients are spread across them
         std::uint16_t workerThreadCount = 2;
 
-    protected:
-        void onConnectedClient(int clientDescriptor);
+        /// Gives every worker its own SO_REUSEPORT listener on the port, so the kernel spreads connections
+        /// across workers and a connection never leaves the worker that accepted it.
+        /// Set workerThreadCount to the core count to scale accepts per core. Must be set before bindAndListen
+        bool shardedAccept = false;
 
+        /// Pins worker i to core i % hardware_concurrency. Must be set before bindAndListen
+        bool pinWorkerThreads = false;
+
+    protected:
         void disconnectInternal(int clientDescriptor) override {
             closeClient(clientDescriptor);
         }
 
     private:
-        /// Connection listen loop
+        /// A worker thread, the event loop it drives and the channels registered to that loop
+        struct Shard {
+            std::size_t index;
+            std::unique_ptr<EventLoop> eventLoop;
+            // Own SO_REUSEPORT listener when sharding accepts, -1 otherwise
+            int listenDescriptor = -1;
+
+            // Read without locks under a reclaimer pin, removed channels are retired to the reclaimer
+            ChannelTable channels;
+
+            // Handed over by the connection listen thread when accepts aren't sharded
+            moodycamel::ConcurrentQueue<int> acceptedDescriptors;
+
+            std::thread thread;
+        };
+
+        /// Sets socket options on a descriptor, binds it to the port and starts listening
+        void setupListener(int descriptor);
+
+        void onConnectedClient(Shard& shard, int clientDescriptor);
+
+        /// \return false if the descriptor has no channel
+        bool closeClient(Shard& shard, int clientDescriptor);
+
+        /// The channel the handle was issued for, or null. The caller must hold a pin
+        [[nodiscard]] Channel* resolve(ChannelHandle handle) const {
+            if (!handle || handle.shard() >= shards.size()) {
+                return nullptr;
+            }
+
+            auto* channel = shards[handle.shard()]->channels.find(handle.descriptor());
+            return channel != nullptr && channel->handle == handle ? channel : nullptr;
+        }
+
+        /// Closes channels which shut themselves down
+        void closeInactive(Shard& shard);
+
+        /// Removes the client from every group
+        void leaveGroups(int clientDescriptor);
+
+        /// Returns the shard owning the descriptor, or null
+        Shard* findShard(int clientDescriptor);
+
+        /// Connection listen loop, only used when accepts aren't sharded
         void connectionListenLoop();
 
-        void writeLoop();
+        /// Accepts until the listener would block
+        /// \param shard owner of the listener, null to spread connections across every worker
+        void acceptPending(int listenDescriptor, Shard* shard);
+
+        /// Passes a connection accepted by the listen thread to the next worker
+        void handOff(int clientDescriptor);
 
-        void readLoop();
+        /// Accepts and dispatches readiness for the channels owned by shard
+        void workerLoop(Shard& shard);
+
+        // Declared before shards, so it outlives every channel table
+        EpochReclaimer reclaimer;
 
         std::thread connectionListenThread;
+        std::unique_ptr<EventLoop> listenLoop;
+
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::atomic_size_t nextShard = 0;
 
-        ExclusivePrioritySharedMutex clientDescriptorsMutex;
-        std::unordered_map<int, std::unique_ptr<Channel>> clientDescriptors;
-        std::vector<std::thread> workerThreads;
+        // Handle generation of the next accepted client, 0 is never issued
+        std::atomic_uint32_t nextGeneration = 1;
 
-        void threadLoop();
+        // Members are removed under the exclusive lock before their channel is retired,
+        // so holding it shared keeps every member alive
+        ExclusivePrioritySharedMutex groupsMutex;
+        std::unordered_map<std::string, std::unordered_map<int, Channel*>> groups;
     };
 }
\ No newline at end of file
@@ -1,21 +1,30 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <vector>
 #include <functional>
 #include <thread>
 #include <optional>
+#include <deque>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <stdexcept>
 
 #include "queue/blockingconcurrentqueue.h"
 #include "utils/EventCallback.hpp"
 #include "StreamQueue.hpp"
+#include "Framing.hpp"
+#include "EventLoop.hpp"
 
 #include "Message.hpp"
+#include "BufferPool.hpp"
+#include "ChannelHandle.hpp"
+#include "CallbackExecutor.hpp"
 
 namespace SocketLib {
 
@@ -28,13 +37,42 @@ namespace SocketLib {
     using ConnectCallbackFunc = std::function<void(Channel&, bool)>;
     using ListenCallbackFunc = std::function<void(Channel&)>;
 
-    using ConnectEventCallback = Utils::EventCallback<Channel&, bool>;
-    using ListenEventCallback = Utils::EventCallback<Channel&, ReadOnlyStreamQueue&>;
+    // Invoked per event on every channel, so they take no lock
+    using ConnectEventCallback = Utils::SnapshotEventCallback<Channel&, bool>;
+    using ListenEventCallback = Utils::SnapshotEventCallback<Channel&, ReadOnlyStreamQueue&>;
+    // One complete frame's payload, only valid during the call
+    using FrameEventCallback = Utils::SnapshotEventCallback<Channel&, std::span<const uint8_t>>;
+    // true once the channel drained below its low watermarks, false once it crossed a high watermark
+    using WritabilityEventCallback = Utils::SnapshotEventCallback<Channel&, bool>;
+
+    /// What queueWrite does with a message that would take a channel past its hard limit
+    enum class WriteOverflowPolicy {
+        // Discard the message
+        Drop,
+        // Wait for the channel to drain. Drops instead when called from the channel's own loop thread,
+        // or from broadcast/multicast, which must not stall every other recipient on one of them
+        Block,
+        // Shut the channel down
+        Disconnect
+    };
+
+    /// Per channel bounds on bytes and messages queued but not yet sent. 0 disables a limit
+    struct WriteQueueLimits {
+        std::size_t highWatermarkBytes = 1024 * 1024;
+        std::size_t lowWatermarkBytes = 256 * 1024;
+        std::size_t highWatermarkMessages = 0;
+        std::size_t lowWatermarkMessages = 0;
+
+        // Concurrent producers may each overshoot by one message
+        std::size_t maxBytes = 0;
+        std::size_t maxMessages = 0;
+        WriteOverflowPolicy overflowPolicy = WriteOverflowPolicy::Drop;
+    };
 
 
     class Socket {
     public:
-        constexpr static const std::string_view SOCKET_LOG_TAG = "socket_core";
+        constinit static inline LogTag SOCKET_LOG_TAG{"socket_core"};
 
         virtual ~Socket(); // call through SocketHandler
 
@@ -44,7 +82,10 @@ namespace SocketLib {
         constexpr Socket& operator=(const Socket&) = delete;
 
         ListenEventCallback listenCallback;
+        /// Invoked instead of listenCallback once framing is set
+        FrameEventCallback frameCallback;
         ConnectEventCallback connectCallback;
+        WritabilityEventCallback writabilityCallback;
 
         // Friend so can call listen callbacks and disconnect
         friend class Channel;
@@ -60,6 +101,16 @@ namespace SocketLib {
         // Socket settings
         uint32_t bufferSize = 512;
         bool noDelay = false; // must be set before server is bind and listening
+        // Messages coalesced into one sendmsg, capped at IOV_MAX
+        uint32_t writeBatchSize = 64;
+        WriteQueueLimits writeLimits;
+        /// Runs listenCallback on the handler's callback executor instead of the thread reading the channel,
+        /// so a slow handler only holds up its own channel. Events of one channel still run one at a time and in order.
+        /// Must be set before the server is bind and listening or the client connects
+        bool dispatchListenEvents = false;
+        /// Splits received bytes into length prefixed frames for frameCallback.
+        /// Must be set before the server is bind and listening or the client connects
+        FramingOptions framing;
 
         /// The socket handler managing this socket
         /// TODO: Should we even have this or pass it manually where it's needed?
@@ -83,15 +134,30 @@ namespace SocketLib {
 
         virtual void disconnectInternal(int clientDescriptor) = 0;
 
+        /// Runs work on the handler's callback executor, after everything dispatched for the channel before it
+        void dispatchCallback(Channel& channel, WorkT work);
+
+        /// Waits for every callback dispatched by this socket. Must not be called from one of them
+        void awaitCallbacks();
+
+    private:
+        std::atomic_size_t pendingCallbacks = 0;
+        std::mutex callbacksMutex;
+        std::condition_variable callbacksDone;
+
+        void finishCallback();
+
     };
 
     class Channel {
     public:
-        constexpr static const std::string_view CHANNEL_LOG_TAG = "channel";
+        constinit static inline LogTag CHANNEL_LOG_TAG{"channel"};
         constexpr Channel() = delete;
         constexpr Channel(Channel const&) = delete;
 
-        explicit Channel(Socket const& socket, Logger& logger, ListenEventCallback& listenCallback, int clientDescriptor);
+        explicit Channel(Socket const& socket, Logger& logger, ListenEventCallback& listenCallback,
+                         FrameEventCallback& frameCallback, WritabilityEventCallback& writabilityCallback,
+                         int clientDescriptor);
 
         ~Channel();
 
@@ -99,14 +165,43 @@ namespace SocketLib {
 
         /// Will not send if message is empty or null
         /// \param msg
-        void queueWrite(const Message& msg);
+        /// \return false if the message was dropped, see WriteQueueLimits
+        bool queueWrite(const Message& msg);
+        /// Moves msg into the write queue, a heap payload is handed over instead of copied
+        bool queueWrite(Message&& msg);
 
 
 
         const int clientDescriptor;
 
+        /// Issued by the server when it accepts the connection, unlike clientDescriptor it is never reused.
+        /// Empty for client sockets
+        [[nodiscard]] ChannelHandle getHandle() const {
+            return handle;
+        }
+
         [[nodiscard]] bool isActive() const;
 
+        /// False between crossing a high watermark and draining below the low ones
+        [[nodiscard]] bool isWritable() const {
+            return writable.load(std::memory_order_acquire);
+        }
+
+        /// Bytes queued or partially sent
+        [[nodiscard]] std::size_t pendingWriteBytes() const {
+            return pendingBytes.load(std::memory_order_relaxed);
+        }
+
+        /// Readiness events and receive completions handled for this channel
+        [[nodiscard]] uint64_t getReceiveEvents() const {
+            return receiveEvents.load(std::memory_order_relaxed);
+        }
+
+        /// The loop driving this channel, null if it has not been registered to one
+        [[nodiscard]] EventLoop* getEventLoop() const {
+            return eventLoop.load(std::memory_order_acquire);
+        }
+
         /// return false if no data
         /// or failure
         [[nodiscard]]
@@ -117,27 +212,124 @@ namespace SocketLib {
         [[nodiscard]]
         bool handleWriteQueue(moodycamel::ProducerToken const& logToken);
 
+        /// Called by the thread driving the channel's event loop.
+        /// Reads until the socket would block, since readiness is edge triggered
+        void handleEvent(IoEvent const& event, std::span<byte> byteBuf, moodycamel::ProducerToken const& logToken);
+
+        /// Called by the thread driving the channel's event loop after queueWritable
+        void handleScheduledWrite(moodycamel::ProducerToken const& logToken);
+
     private:
+        friend class EventLoop;
+        friend class ServerSocket;
+        friend class Socket;
+
         bool active;
-        std::thread readThread;
-        std::thread writeThread;
+
+        // Set before the channel is published to other threads
+        ChannelHandle handle;
+
+        // Orders the callbacks dispatched for this channel, shared with the ones still queued
+        std::shared_ptr<Strand> strand;
+
+        // Loop this channel is registered to, null until accepted into one
+        std::atomic<EventLoop*> eventLoop = nullptr;
+        std::atomic_bool writeScheduled = false;
 
         std::mutex readLock;
         std::mutex writeLock;
 
         StreamQueue incomingQueue;
 
+        // With dispatchListenEvents, incomingQueue only stages received bytes under stagingMutex
+        // and listeners read dispatchedQueue on the strand
+        std::mutex stagingMutex;
+        bool deliveryScheduled = false;
+        StreamQueue dispatchedQueue;
+
         Socket const& socket;
 
         // Owned by socket, which owns Channel
         Logger& logger;
         ListenEventCallback& listenCallback;
+        FrameEventCallback& frameCallback;
+        WritabilityEventCallback& writabilityCallback;
 
-        moodycamel::BlockingConcurrentQueue<Message> writeQueue;
+        // Used under readLock, or on the strand with dispatchListenEvents
+        FrameDecoder frameDecoder;
+        // SO_RCVLOWAT we set, 0 while the kernel default applies. Under readLock
+        int receiveLowWatermark = 0;
+        std::atomic_uint64_t receiveEvents = 0;
+
+        // Blocks come from the default BufferAllocator like the messages in them
+        moodycamel::BlockingConcurrentQueue<Message, PooledQueueTraits<moodycamel::ConcurrentQueueDefaultTraits>> writeQueue;
 
         Logger& getLogger();
-        void sendMessage(const Message& message);
-        void sendBytes(std::span<const byte> bytes);
+
+        // Everything accepted by queueWrite and not yet sent, both writeQueue and outbound
+        std::atomic_size_t pendingBytes = 0;
+        std::atomic_size_t pendingMessages = 0;
+        std::atomic_bool writable = true;
+        // Set while dispatching, Block would deadlock there
+        std::atomic<std::thread::id> loopThread;
+
+        // Producers waiting under WriteOverflowPolicy::Block
+        std::mutex drainMutex;
+        std::condition_variable drained;
+        std::atomic_uint32_t blockedWriters = 0;
+
+        /// queueWrite without scheduling the flush, for callers that schedule many channels at once.
+        /// Fan out passes mayBlock false, WriteOverflowPolicy::Block drops then
+        bool enqueueWrite(const Message& msg, bool mayBlock = true);
+        bool enqueueWrite(Message&& msg);
+        /// Checks and accounts for a message about to be queued
+        bool acceptWrite(const Message& msg, bool mayBlock);
+        /// Wakes the loop so it can flush, otherwise the message waits for the next readiness event
+        void scheduleFlush();
+
+        [[nodiscard]] bool exceedsLimit(std::size_t bytes) const;
+        /// Applies the overflow policy, then accounts for the message
+        /// \return false if the message must not be queued
+        bool reserveWrite(std::size_t bytes, bool mayBlock);
+        /// Accounts for sent bytes and finished messages
+        void releaseWrite(std::size_t bytes, std::size_t messages);
+        void notifyWritability(bool isWritable);
+
+        /// Tops outbound up to the write batch size from writeQueue
+        /// \return the amount of messages in outbound
+        std::size_t fillOutbound();
+        /// Points outbound's iovecs and header at its unsent part
+        void gatherOutbound();
+        /// Drops sent bytes from the front of outbound
+        void consumeOutbound(std::size_t sent);
+        /// Writes outbound with one sendmsg per batch until it's empty or the socket would block
+        /// \return true if anything was written
+        bool sendOutbound();
+
+        bool handleReceived(long recv_bytes, int err, std::span<byte> byteBuf, moodycamel::ProducerToken const& logToken);
+
+        /// Stages received bytes and schedules deliverReceived if it isn't already
+        void dispatchReceived(std::span<byte> bytes);
+        /// Runs on the strand, hands every staged byte to listenCallback
+        void deliverReceived();
+        /// Hands every complete frame in pending followed by bytes to frameCallback, keeping the rest in pending
+        /// \return false if the peer sent an invalid frame, the channel is shut down then
+        bool receiveFrames(StreamQueue& pending, std::span<byte> bytes);
+        /// Before waiting for more bytes, lets the kernel hold the wakeup until the pending frame can complete
+        void updateReceiveLowWatermark();
+
+        // Completion based loops, see EventLoop::submitSend
+        bool submitWriteQueue(EventLoop& loop);
+        void handleSent(long result, moodycamel::ProducerToken const& logToken);
+
+        // Messages dequeued from writeQueue and not fully sent yet.
+        // Shared with completion based loops, which keep it alive until a send in flight completes
+        std::shared_ptr<SendBatch> outbound = std::make_shared<SendBatch>();
+        // Already sent from the front message
+        std::size_t outboundOffset = 0;
+        bool sendInFlight = false;
+        // Readiness loops, the send buffer is full until the next writable event
+        bool writeBlocked = false;
 
         void awaitShutdown();
 
@@ -3,6 +3,8 @@
 #include "Socket.hpp"
 #include "ServerSocket.hpp"
 #include "ClientSocket.hpp"
+#include "EventLoop.hpp"
+#include "CallbackExecutor.hpp"
 #include "queue/blockingconcurrentqueue.h"
 
 #include <mutex>
@@ -15,11 +17,10 @@
 #define SOCKET_LIB_MAX_QUEUE_SIZE 40
 
 namespace SocketLib {
-    using WorkT = std::function<void()>;
 
     class SocketHandler {
     public:
-        constexpr static const std::string_view SOCKET_HANDLER_LOG_TAG = "socket_handler";
+        constinit static inline LogTag SOCKET_HANDLER_LOG_TAG{"socket_handler"};
 
         /// Creates a socket handler with the specified amount of threads in the thread pool
         /// \param maxThreads
@@ -53,6 +54,23 @@ namespace SocketLib {
         }
 
 
+        /// Creates an event loop using ioBackend, falling back to epoll if it cannot be set up
+        /// \param bufferSize receive buffer size per channel for backends that own their buffers
+        std::unique_ptr<EventLoop> createEventLoop(uint32_t bufferSize);
+
+        /// Backend used by sockets that start listening or connect after this is set
+        IoBackend ioBackend = IoBackend::Epoll;
+
+        /// Threads running socket callbacks, 0 for one per core. Must be set before the first socket connects
+        std::size_t callbackThreadCount = 0;
+
+        /// Callbacks waiting at once before further ones run on the thread dispatching them.
+        /// Must be set before the first socket connects
+        std::size_t maxQueuedCallbacks = 64 * 1024;
+
+        /// Shared by every socket of this handler, created on first use
+        CallbackExecutor& getCallbackExecutor();
+
         /// A common instance that can be used with multiple sockets.
         /// \return
         static SocketHandler& getCommonSocketHandler();
@@ -78,8 +96,8 @@ namespace SocketLib {
         uint32_t nextId = 0;
         bool active;
 
-        /// The thread loop for the thread pool
-        void threadLoop();
+        std::once_flag callbackExecutorOnce;
+        std::unique_ptr<CallbackExecutor> callbackExecutor;
 
         std::unordered_map<uint32_t, std::unique_ptr<Socket>> sockets;
         std::shared_mutex socketMutex;
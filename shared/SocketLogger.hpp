@@ -1,5 +1,6 @@
 #pragma once
 
+#include "LogRing.hpp"
 #include "utils/EventCallback.hpp"
 #include "queue/blockingconcurrentqueue.h"
 
@@ -15,9 +16,18 @@
 #warning Paper log is highly recommended for quest!
 #endif
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 #include <fmt/core.h>
 
 namespace SocketLib {
@@ -39,9 +49,50 @@ namespace SocketLib {
         ERROR = 6
     };
 
+    /// Token bucket for one log call site, usually a function local static.
+    /// Lock free, so threads hitting the same site never wait on each other
+    class RateLimit {
+    public:
+        /// perSecond tokens are added every second, up to burst
+        constexpr RateLimit(uint32_t perSecond, uint32_t burst)
+                : interval(1'000'000'000 / std::max<uint32_t>(perSecond, 1)),
+                  tolerance(interval * std::max<int64_t>(static_cast<int64_t>(burst) - 1, 0)) {}
+
+        RateLimit(RateLimit const &) = delete;
+        RateLimit &operator=(RateLimit const &) = delete;
+
+        /// Takes a token. nullopt if there was none, otherwise how many calls were refused since the last one
+        std::optional<uint64_t> tryAcquire() {
+            auto const now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+
+            // Tracks when the bucket would be full again instead of a token count, so one CAS updates it
+            auto arrival = nextArrival.load(std::memory_order_relaxed);
+            while (true) {
+                if (arrival - tolerance > now) {
+                    suppressed.fetch_add(1, std::memory_order_relaxed);
+                    return std::nullopt;
+                }
+
+                if (nextArrival.compare_exchange_weak(arrival, std::max(arrival, now) + interval,
+                                                      std::memory_order_relaxed)) {
+                    return suppressed.exchange(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+    private:
+        int64_t const interval;
+        int64_t const tolerance;
+        std::atomic_int64_t nextArrival = 0;
+        std::atomic_uint64_t suppressed = 0;
+    };
+
     class Logger {
     public:
-        Logger() = default;
+        constexpr static std::size_t MAX_LEVEL_TAGS = 256;
+
+        Logger();
 
         Logger(Logger const &) = delete;
 
@@ -63,28 +114,107 @@ namespace SocketLib {
         bool DebugEnabled;
         Utils::UnorderedEventCallback<LoggerLevel, std::string const &, std::string const &> loggerCallback;
 
+        /// Log calls copy their arguments into a ring owned by the calling thread and the logger thread
+        /// formats them, so logging doesn't format or allocate. Logs that don't fit the ring are dropped.
+        /// Format strings are kept by pointer, so fmt::runtime strings have to outlive the logger thread's drain
+        std::atomic_bool deferFormatting = false;
+
+        /// Logs of tag below minimum are skipped. Can be changed while logging
+        void setLevel(std::string_view tag, LoggerLevel minimum);
+        /// Tag follows the default level again
+        void resetLevel(std::string_view tag);
+        /// For every tag without its own level
+        void setDefaultLevel(LoggerLevel minimum);
+
+        [[nodiscard]] LoggerLevel getLevel(std::string_view tag) const;
+
+        /// DEBUG additionally needs DebugEnabled
+        template<LoggerLevel lvl>
+        [[nodiscard]] bool isEnabled(LogTagView tag) const {
+            if constexpr (lvl == LoggerLevel::DEBUG_LEVEL) {
+                if (!DebugEnabled) {
+                    return false;
+                }
+            }
+
+            auto const tagId = tag.getId();
+            auto const &minimum = tagId < MAX_LEVEL_TAGS ? tagLevels[tagId] : defaultLevel;
+            return static_cast<uint8_t>(lvl) >= minimum.load(std::memory_order_relaxed);
+        }
+
         template<LoggerLevel lvl, typename... TArgs>
-        constexpr void fmtLog(std::string_view tag, fmt::format_string<TArgs...> str, TArgs &&... args) {
-            writeLog<lvl>(tag, fmt::format<TArgs...>(str, std::forward<TArgs>(args)...));
+        constexpr void fmtLog(LogTagView tag, fmt::format_string<TArgs...> str, TArgs &&... args) {
+            if (!isEnabled<lvl>(tag)) {
+                return;
+            }
+
+            if constexpr ((detail::Deferrable<TArgs> && ...)) {
+                if (deferring()) {
+                    writeRecord(lvl, tag, formatLiteral(str), args...);
+                    return;
+                }
+            }
+
+            emit(lvl, tag, fmt::format<TArgs...>(str, std::forward<TArgs>(args)...));
+        }
+
+        /// Logs only while limit has tokens. The first log let through after some were suppressed
+        /// is preceded by a line saying how many
+        template<LoggerLevel lvl, typename... TArgs>
+        constexpr void
+        fmtLog(RateLimit &limit, LogTagView tag, fmt::format_string<TArgs...> str, TArgs &&... args) {
+            if (!isEnabled<lvl>(tag)) {
+                return;
+            }
+
+            auto const suppressed = limit.tryAcquire();
+            if (!suppressed) {
+                return;
+            }
+
+            if (*suppressed > 0) {
+                fmtLog<lvl>(tag, "Suppressed {} similar logs", *suppressed);
+            }
+            fmtLog<lvl, TArgs...>(tag, str, std::forward<TArgs>(args)...);
         }
 
         template<typename Exception = std::runtime_error, typename... TArgs>
-        inline void fmtThrowError(std::string_view tag, fmt::format_string<TArgs...> str, TArgs &&... args) {
+        inline void fmtThrowError(LogTagView tag, fmt::format_string<TArgs...> str, TArgs &&... args) {
             fmtLog<LoggerLevel::ERROR, TArgs...>(tag, str, std::forward<TArgs>(args)...);
             throw Exception(fmt::format<TArgs...>(str, std::forward<TArgs>(args)...));
         }
 
         template<LoggerLevel lvl>
-        constexpr void writeLog(std::string_view const tag, std::string_view const log) {
-            if constexpr (lvl == LoggerLevel::DEBUG_LEVEL) {
-                if (!DebugEnabled) {
-                    return;
-                }
+        constexpr void writeLog(LogTagView tag, std::string_view const log) {
+            if (!isEnabled<lvl>(tag)) {
+                return;
             }
 
-            queueLogInternal(lvl, tag, log);
+            emit(lvl, tag, log);
         }
 
+        /// Writes a record to this thread's ring, format must outlive the logger thread formatting it
+        template<LoggerLevel lvl, typename... TArgs>
+        void deferLog(LogTagView tag, std::string_view format, TArgs const &... args) {
+            if (!isEnabled<lvl>(tag)) {
+                return;
+            }
+
+            writeRecord(lvl, tag, format, args...);
+        }
+
+        /// Formats every deferred record and hands it to loggerCallback, oldest first.
+        /// The SocketHandler's logger thread calls this, loggers without one have to call it themselves
+        void drainDeferred();
+
+        /// Logs thrown away because the queue or the thread's ring was full, logging never waits for room
+        [[nodiscard]] std::size_t getDroppedLogs() const {
+            return droppedLogs.load(std::memory_order_relaxed);
+        }
+
+        /// Logs waiting for the logger thread past this are dropped
+        std::atomic_size_t maxQueuedLogs = 64 * 1024;
+
         void queueLogInternal(LoggerLevel level, std::string_view tag, std::string_view log);
 
         [[nodiscard]] moodycamel::ProducerToken createProducerToken() {
@@ -96,14 +226,25 @@ namespace SocketLib {
 
         template<LoggerLevel lvl, typename... TArgs>
         constexpr void
-        fmtLog(moodycamel::ProducerToken const &producer, std::string_view tag, fmt::format_string<TArgs...> str,
+        fmtLog(moodycamel::ProducerToken const &producer, LogTagView tag, fmt::format_string<TArgs...> str,
                TArgs &&... args) {
-            writeLog<lvl>(producer, tag, fmt::format<TArgs...>(str, std::forward<TArgs>(args)...));
+            if (!isEnabled<lvl>(tag)) {
+                return;
+            }
+
+            if constexpr ((detail::Deferrable<TArgs> && ...)) {
+                if (deferring()) {
+                    writeRecord(lvl, tag, formatLiteral(str), args...);
+                    return;
+                }
+            }
+
+            emit(producer, lvl, tag, fmt::format<TArgs...>(str, std::forward<TArgs>(args)...));
         }
 
         template<typename Exception = std::runtime_error, typename... TArgs>
         inline void
-        fmtThrowError(moodycamel::ProducerToken const &producer, std::string_view tag, fmt::format_string<TArgs...> str,
+        fmtThrowError(moodycamel::ProducerToken const &producer, LogTagView tag, fmt::format_string<TArgs...> str,
                       TArgs &&... args) {
             fmtLog<LoggerLevel::ERROR, TArgs...>(producer, tag, str, std::forward<TArgs>(args)...);
             throw Exception(fmt::format<TArgs...>(str, std::forward<TArgs>(args)...));
@@ -111,13 +252,12 @@ namespace SocketLib {
 
         template<LoggerLevel lvl>
         constexpr void
-        writeLog(moodycamel::ProducerToken const &token, std::string_view const tag, std::string_view const log) {
-            if constexpr (lvl == LoggerLevel::DEBUG_LEVEL) {
-                if (!DebugEnabled) {
-                    return;
-                }
+        writeLog(moodycamel::ProducerToken const &token, LogTagView tag, std::string_view const log) {
+            if (!isEnabled<lvl>(tag)) {
+                return;
             }
-            queueLogInternal(token, lvl, tag, log);
+
+            emit(token, lvl, tag, log);
         }
 
         void queueLogInternal(moodycamel::ProducerToken const &producer, LoggerLevel level, std::string_view tag,
@@ -139,6 +279,94 @@ namespace SocketLib {
 
         moodycamel::BlockingConcurrentQueue<LogTask> logQueue;
 
+        static uint64_t nextLoggerId();
+
+        uint64_t const id = nextLoggerId();
+
+        std::mutex ringsMutex;
+        // One per thread that deferred a log
+        std::vector<std::shared_ptr<LogRing>> rings;
+        std::atomic_size_t droppedLogs = 0;
+
+        /// Paper formats on its own thread already, deferring would only add a hop
+        [[nodiscard]] bool deferring() const {
+#ifdef SOCKETLIB_PAPER_LOG
+            return false;
+#else
+            return deferFormatting.load(std::memory_order_relaxed);
+#endif
+        }
+
+        /// Checked format strings are string literals, so records keep a pointer to them
+        static constexpr std::string_view formatLiteral(fmt::string_view format) {
+            return {format.data(), format.size()};
+        }
+
+        /// nullptr once the thread is exiting
+        LogRing *threadRing();
+
+        std::array<std::atomic_uint8_t, MAX_LEVEL_TAGS> tagLevels;
+        std::atomic_uint8_t defaultLevel = static_cast<uint8_t>(LoggerLevel::DEBUG_LEVEL);
+
+        std::mutex levelsMutex;
+        // Tags given their own level, the rest follow defaultLevel
+        std::bitset<MAX_LEVEL_TAGS> explicitLevels;
+
+        void emit(LoggerLevel level, LogTagView tag, std::string_view log) {
+            if (deferring()) {
+                writeRecord(level, tag, "{}", log);
+                return;
+            }
+
+            queueLogInternal(level, tag.getName(), log);
+        }
+
+        void emit(moodycamel::ProducerToken const &token, LoggerLevel level, LogTagView tag,
+                  std::string_view log) {
+            if (deferring()) {
+                writeRecord(level, tag, "{}", log);
+                return;
+            }
+
+            queueLogInternal(token, level, tag.getName(), log);
+        }
+
+        template<typename... TArgs>
+        void writeRecord(LoggerLevel level, LogTagView tag, std::string_view format, TArgs const &... args) {
+            auto const size = sizeof(LogRecordHeader) +
+                              (std::size_t(0) + ... + detail::deferredSize<std::remove_cvref_t<TArgs>>(args));
+
+            auto *ring = threadRing();
+            if (ring == nullptr) {
+                queueLogInternal(level, tag.getName(), fmt::vformat(format, fmt::make_format_args(args...)));
+                return;
+            }
+
+            auto *record = ring->reserve(size);
+            if (record == nullptr) {
+                droppedLogs.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            LogRecordHeader const header{
+                    static_cast<uint32_t>(size),
+                    tag.getId(),
+                    level,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count(),
+                    &detail::formatDeferred<detail::DeferredStorage<TArgs>...>,
+                    format.data(),
+                    format.size()
+            };
+            std::memcpy(record, &header, sizeof(header));
+
+            [[maybe_unused]] auto *out = record + sizeof(header);
+            ((out = detail::encodeDeferred<std::remove_cvref_t<TArgs>>(out, args)), ...);
+
+            ring->commit();
+        }
+
+
         friend class SocketHandler;
     };
 }
\ No newline at end of file
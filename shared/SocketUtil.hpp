@@ -72,27 +72,27 @@ namespace SocketLib {
         }
 
         template<LoggerLevel lvl = LoggerLevel::ERROR>
-        static void logIfError(Logger& logger, void* status, std::string_view message, std::string_view tag) {
+        static void logIfError(Logger& logger, void* status, std::string_view message, LogTagView tag) {
             if (!status) {
                 logger.fmtLog<lvl>(tag, "Failed to run method because of null. At: {}", message);
             }
         }
 
         template<bool isStatusError = false, LoggerLevel lvl = LoggerLevel::ERROR>
-        static void logIfError(Logger& logger, int status, std::string_view tag, std::string_view message) {
+        static void logIfError(Logger& logger, int status, LogTagView tag, std::string_view message) {
             if (status != 0) {
                 logger.fmtLog<lvl>(tag, "Failed to run method: At: {} Cause: {}", message, getProperErrorString<isStatusError>(status));
             }
         }
 
-        constexpr static void throwIfError(Logger& logger, void* status, std::string_view tag) {
+        constexpr static void throwIfError(Logger& logger, void* status, LogTagView tag) {
             if (!status) {
                 logger.fmtThrowError(tag, "Failed to run method because of null");
             }
         }
 
         template<bool isStatusError = false>
-        static void throwIfError(Logger& logger, int status, std::string_view tag, int eq = 0) {
+        static void throwIfError(Logger& logger, int status, LogTagView tag, int eq = 0) {
             if (status != eq) {
                 logger.fmtThrowError(tag, "Failed to run method: {}", getProperErrorString<isStatusError>(status));
             }
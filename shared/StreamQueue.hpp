@@ -1,89 +1,246 @@
 #pragma once
 
-#include <queue>
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <new>
 #include <span>
+#include <utility>
+#include <vector>
 #include "Message.hpp"
+#include "ByteSearch.hpp"
 
 namespace SocketLib {
 
+    /// Received bytes waiting to be parsed.
+    /// Stored in a growable ring buffer, so parsers can work on the bytes in place through
+    /// readableSpans/peekContiguous and drop them with consume. Only the dequeue methods copy
     struct ReadOnlyStreamQueue {
 
         ReadOnlyStreamQueue() = default;
 
-        ReadOnlyStreamQueue(std::span<uint8_t> bytes) : bytes(bytes.begin(), bytes.end()) {};
+        /// The ring buffer is taken from allocator, which must outlive the queue
+        explicit ReadOnlyStreamQueue(BufferAllocator &allocator) : allocator(&allocator) {}
 
-        ReadOnlyStreamQueue(ReadOnlyStreamQueue &&) noexcept = default;
+        ReadOnlyStreamQueue(std::span<uint8_t> bytes) {
+            append(bytes);
+        };
 
-        explicit ReadOnlyStreamQueue(ReadOnlyStreamQueue const &) = default;
+        ReadOnlyStreamQueue(ReadOnlyStreamQueue &&other) noexcept
+                : allocator(other.allocator),
+                  buffer(std::exchange(other.buffer, nullptr)),
+                  capacity(std::exchange(other.capacity, 0)),
+                  head(std::exchange(other.head, 0)),
+                  size(std::exchange(other.size, 0)) {}
 
-        virtual ~ReadOnlyStreamQueue() = default;
+        explicit ReadOnlyStreamQueue(ReadOnlyStreamQueue const &other) : allocator(other.allocator) {
+            reserve(other.size);
+            size = other.copyTo({buffer, other.size});
+        }
 
-        std::deque<uint8_t> dequeue(std::size_t maxCount = std::numeric_limits<std::size_t>::max()) {
-            // Determine the actual number of elements to dequeue
-            std::size_t countToDequeue = std::min(maxCount, bytes.size());
+        virtual ~ReadOnlyStreamQueue() {
+            releaseBuffer();
+        }
+
+        /// The queued bytes in order. The second span is only non-empty when the bytes wrap around the ring.
+        /// Valid until the queue is modified
+        [[nodiscard]] std::array<std::span<const uint8_t>, 2> readableSpans() const {
+            auto const first = std::min(size, capacity - head);
 
-            // Move elements from the internal deque to the new queue using bulk move
-            std::deque<uint8_t> newDeque(std::make_move_iterator(bytes.begin()),
-                                         std::make_move_iterator(bytes.begin() + countToDequeue));
+            return {
+                    std::span<const uint8_t>(buffer + head, first),
+                    std::span<const uint8_t>(buffer, size - first)
+            };
+        }
 
-            // Erase the moved elements from the internal deque
-            bytes.erase(bytes.begin(), bytes.begin() + countToDequeue);
+        /// The first n bytes (or all of them if fewer are queued) as a single span.
+        /// Only moves bytes if those n wrap around the ring. Valid until the queue is modified
+        std::span<const uint8_t> peekContiguous(std::size_t n) {
+            n = std::min(n, size);
 
-            return newDeque;
+            if (head + n > capacity) {
+                linearize();
+            }
 
-//            for (uint8_t i = 0; i < maxCount && !bytes.empty(); ++i) {
-//                newQueue.push(bytes.front());
-//                bytes.pop();
-//            }
-//
-//            return newQueue;
+            return {buffer + head, n};
         }
 
-        std::vector<uint8_t> dequeueAsVec(std::size_t maxCount = std::numeric_limits<std::size_t>::max()) {
-//            // Determine the actual number of elements to dequeue
-            std::size_t countToDequeue = std::min(maxCount, bytes.size());
-//
-//            // Move elements from the internal deque to the new queue using bulk move
-//            std::vector<uint8_t> newDeque(std::make_move_iterator(bytes.begin()),
-//                                         std::make_move_iterator(bytes.begin() + countToDequeue));
-//
-//            // Erase the moved elements from the internal deque
-//            bytes.erase(bytes.begin(), bytes.begin() + countToDequeue);
-//
-//            return newDeque;
-
-            std::vector<uint8_t> newQueue(countToDequeue);
-
-            for (uint8_t i = 0; i < maxCount && !bytes.empty(); ++i) {
-                newQueue[i] = bytes.front();
-                bytes.pop_front();
+        /// Position of the first value at or after from, Utils::BYTE_NOT_FOUND if there is none.
+        /// Searches both halves of the ring without moving bytes
+        [[nodiscard]] std::size_t find(uint8_t value, std::size_t from = 0) const {
+            std::size_t offset = 0;
+
+            for (auto span: readableSpans()) {
+                if (from < offset + span.size()) {
+                    auto const start = from > offset ? from - offset : 0;
+                    auto const found = Utils::findByte(span.subspan(start), value);
+                    if (found != Utils::BYTE_NOT_FOUND) {
+                        return offset + start + found;
+                    }
+                }
+                offset += span.size();
             }
 
+            return Utils::BYTE_NOT_FOUND;
+        }
+
+        /// Drops up to n bytes from the front
+        /// \return the amount dropped
+        std::size_t consume(std::size_t n) {
+            n = std::min(n, size);
+
+            size -= n;
+            head = size == 0 ? 0 : (head + n) & (capacity - 1);
+
+            // Don't let one burst pin a large buffer on an idle channel
+            if (size == 0 && capacity > RETAINED_CAPACITY) {
+                releaseBuffer();
+            }
+
+            return n;
+        }
+
+        /// Copies up to destination.size() bytes from the front without consuming them
+        /// \return the amount copied
+        std::size_t copyTo(std::span<uint8_t> destination) const {
+            std::size_t copied = 0;
+
+            for (auto span: readableSpans()) {
+                auto count = std::min(span.size(), destination.size() - copied);
+                if (count == 0) {
+                    break;
+                }
+
+                std::memcpy(destination.data() + copied, span.data(), count);
+                copied += count;
+            }
+
+            return copied;
+        }
+
+        std::deque<uint8_t> dequeue(std::size_t maxCount = std::numeric_limits<std::size_t>::max()) {
+            std::deque<uint8_t> newDeque;
+
+            auto remaining = std::min(maxCount, size);
+            for (auto span: readableSpans()) {
+                auto count = std::min(span.size(), remaining);
+                newDeque.insert(newDeque.end(), span.begin(), span.begin() + count);
+                remaining -= count;
+            }
+
+            consume(newDeque.size());
+            return newDeque;
+        }
+
+        std::vector<uint8_t> dequeueAsVec(std::size_t maxCount = std::numeric_limits<std::size_t>::max()) {
+            std::vector<uint8_t> newQueue(std::min(maxCount, size));
+
+            consume(copyTo(newQueue));
             return newQueue;
         }
 
         Message dequeAsMessage(std::size_t maxCount = std::numeric_limits<std::size_t>::max()) {
-            auto newQueue = this->dequeueAsVec(maxCount);
+            Message message(std::min(maxCount, size));
 
-            return Message(newQueue);
+            consume(copyTo({message.data(), message.length()}));
+            return message;
         }
 
         std::vector<uint8_t> peek(std::size_t maxCount = std::numeric_limits<std::size_t>::max()) {
-            // Determine the actual number of elements to dequeue
-            std::size_t countToDequeue = std::min(maxCount, bytes.size());
+            std::vector<uint8_t> newQueue(std::min(maxCount, size));
 
-
-            return {bytes.cbegin(), bytes.cbegin() + countToDequeue};
+            copyTo(newQueue);
+            return newQueue;
         }
 
         [[nodiscard]] std::size_t queueSize() const {
-            return bytes.size();
+            return size;
         }
 
 
     protected:
-        std::deque<uint8_t> bytes;
+        // Ring buffers up to this size are kept when the queue empties
+        constexpr static std::size_t RETAINED_CAPACITY = 64 * 1024;
+        constexpr static std::size_t MIN_CAPACITY = 1024;
+
+        BufferAllocator *allocator = &BufferAllocator::getDefault();
+        // Capacity is always a power of two, so wrapping is a mask
+        uint8_t *buffer = nullptr;
+        std::size_t capacity = 0;
+        std::size_t head = 0;
+        std::size_t size = 0;
+
+        /// Makes room for n more bytes, the queued bytes start at 0 afterwards if it had to grow
+        void reserve(std::size_t n) {
+            if (size + n <= capacity) {
+                return;
+            }
+
+            auto newCapacity = std::bit_ceil(std::max(size + n, MIN_CAPACITY));
+            auto *newBuffer = allocator->allocate(newCapacity);
+            if (newBuffer == nullptr) {
+                throw std::bad_alloc();
+            }
+
+            copyTo({newBuffer, size});
+
+            auto const queued = size;
+            releaseBuffer();
+
+            buffer = newBuffer;
+            capacity = newCapacity;
+            size = queued;
+        }
+
+        void releaseBuffer() {
+            if (buffer != nullptr) {
+                allocator->deallocate(buffer, capacity);
+            }
+
+            buffer = nullptr;
+            capacity = 0;
+            head = 0;
+            size = 0;
+        }
+
+        /// Moves the queued bytes to the start of the buffer
+        void linearize() {
+            std::rotate(buffer, buffer + head, buffer + capacity);
+            head = 0;
+        }
+
+        void append(std::span<const uint8_t> bytes) {
+            if (bytes.empty()) {
+                return;
+            }
+            reserve(bytes.size());
+
+            auto const tail = (head + size) & (capacity - 1);
+            auto const first = std::min(bytes.size(), capacity - tail);
+
+            std::memcpy(buffer + tail, bytes.data(), first);
+            std::memcpy(buffer, bytes.data() + first, bytes.size() - first);
+            size += bytes.size();
+        }
+
+        void prepend(std::span<const uint8_t> bytes) {
+            if (bytes.empty()) {
+                return;
+            }
+            reserve(bytes.size());
+
+            head = (head - bytes.size()) & (capacity - 1);
+            auto const first = std::min(bytes.size(), capacity - head);
+
+            std::memcpy(buffer + head, bytes.data(), first);
+            std::memcpy(buffer, bytes.data() + first, bytes.size() - first);
+            size += bytes.size();
+        }
     };
 
     struct StreamQueue final : public ReadOnlyStreamQueue {
@@ -99,26 +256,40 @@ namespace SocketLib {
         ~StreamQueue() final = default;
 
         void enqueue(std::span<uint8_t> newBytes) {
-            this->bytes.insert(this->bytes.end(), newBytes.begin(), newBytes.end());
+            append(newBytes);
         }
 
         void enqueueMove(std::span<uint8_t> newBytes) {
-            this->bytes.insert(this->bytes.end(), std::make_move_iterator(newBytes.begin()),
-                               std::make_move_iterator(newBytes.end()));
+            append(newBytes);
         }
 
         void enqueue(std::vector<uint8_t> &&newBytes) {
-            // Move the elements from newBytes and insert them at the beginning of the internal deque
-            this->bytes.insert(this->bytes.end(), std::make_move_iterator(newBytes.begin()),
-                               std::make_move_iterator(newBytes.end()));
+            append(newBytes);
         }
 
         void enqueue(Message &&newBytes) {
-            // Move the elements from newBytes and insert them at the beginning of the internal deque
-            this->bytes.insert(this->bytes.begin(), std::make_move_iterator(newBytes.data()),
-                               std::make_move_iterator(newBytes.data() + newBytes.length()));
+            // Inserted at the beginning of the queue
+            prepend(newBytes.toSpan());
+        }
+
+        /// Moves every byte of other to the back of this queue, leaving other empty.
+        /// Takes other's buffer instead of copying if this queue is empty
+        void splice(StreamQueue &other) {
+            if (size == 0) {
+                std::swap(allocator, other.allocator);
+                std::swap(buffer, other.buffer);
+                std::swap(capacity, other.capacity);
+                std::swap(head, other.head);
+                std::swap(size, other.size);
+                return;
+            }
+
+            for (auto span: other.readableSpans()) {
+                append(span);
+            }
+            other.consume(other.size);
         }
 
     };
 
-}
\ No newline at end of file
+}
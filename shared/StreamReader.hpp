@@ -0,0 +1,215 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include "StreamQueue.hpp"
+
+namespace SocketLib {
+
+    /// Cursor for parsing the front of a queue in place.
+    /// Reads advance the cursor without consuming anything, commit drops everything read so far and
+    /// rollback (or destroying the reader) leaves the queue as it was, so a message can be parsed optimistically
+    /// and retried once more bytes arrive. A read that lacks bytes returns nullopt and doesn't move the cursor.
+    /// Never allocates, values straddling the end of the ring are copied through the stack.
+    /// The queue must not be modified elsewhere while a reader is in use
+    class StreamReader {
+    public:
+        constexpr static std::size_t MAX_VARINT_SIZE = 10;
+
+        explicit StreamReader(ReadOnlyStreamQueue &queue) : queue(queue), spans(queue.readableSpans()) {}
+
+        StreamReader(StreamReader const &) = delete;
+        StreamReader &operator=(StreamReader const &) = delete;
+
+        /// Bytes read since the last commit or rollback
+        [[nodiscard]] std::size_t position() const {
+            return offset;
+        }
+
+        [[nodiscard]] std::size_t remaining() const {
+            return queue.queueSize() - offset;
+        }
+
+        /// Set once a varint doesn't fit 64 bits, nothing after it can be parsed
+        [[nodiscard]] bool malformed() const {
+            return invalid;
+        }
+
+        /// Consumes everything read so far
+        void commit() {
+            queue.consume(offset);
+            spans = queue.readableSpans();
+            offset = 0;
+        }
+
+        /// Moves the cursor back to the last commit
+        void rollback() {
+            offset = 0;
+            invalid = false;
+        }
+
+        template<std::unsigned_integral T, std::endian order>
+        std::optional<T> read() {
+            std::array<uint8_t, sizeof(T)> scratch;
+            auto const bytes = bytesAt(offset, scratch);
+            if (bytes.size() < sizeof(T)) {
+                return std::nullopt;
+            }
+
+            T value = 0;
+            for (std::size_t i = 0; i < sizeof(T); i++) {
+                auto const shift = order == std::endian::big ? (sizeof(T) - 1 - i) * 8 : i * 8;
+                value |= static_cast<T>(static_cast<T>(bytes[i]) << shift);
+            }
+
+            offset += sizeof(T);
+            return value;
+        }
+
+        std::optional<uint8_t> readU8() {
+            return read<uint8_t, std::endian::little>();
+        }
+
+        std::optional<uint16_t> readU16LE() {
+            return read<uint16_t, std::endian::little>();
+        }
+
+        std::optional<uint16_t> readU16BE() {
+            return read<uint16_t, std::endian::big>();
+        }
+
+        std::optional<uint32_t> readU32LE() {
+            return read<uint32_t, std::endian::little>();
+        }
+
+        std::optional<uint32_t> readU32BE() {
+            return read<uint32_t, std::endian::big>();
+        }
+
+        std::optional<uint64_t> readU64LE() {
+            return read<uint64_t, std::endian::little>();
+        }
+
+        std::optional<uint64_t> readU64BE() {
+            return read<uint64_t, std::endian::big>();
+        }
+
+        /// Unsigned LEB128, 7 bits per byte, low bits first. Sets malformed if it doesn't fit 64 bits
+        std::optional<uint64_t> readVarint() {
+            std::array<uint8_t, MAX_VARINT_SIZE> scratch;
+            auto const bytes = bytesAt(offset, scratch);
+
+            uint64_t value = 0;
+            for (std::size_t i = 0; i < bytes.size(); i++) {
+                auto const bits = static_cast<uint64_t>(bytes[i] & 0x7F);
+                // The tenth byte only has room for the top bit
+                if (i == MAX_VARINT_SIZE - 1 && bits > 1) {
+                    invalid = true;
+                    return std::nullopt;
+                }
+
+                value |= bits << (7 * i);
+                if ((bytes[i] & 0x80) == 0) {
+                    offset += i + 1;
+                    return value;
+                }
+            }
+
+            if (bytes.size() == MAX_VARINT_SIZE) {
+                invalid = true;
+            }
+            return std::nullopt;
+        }
+
+        /// The next n bytes in place, as two spans like readableSpans. The second is only non-empty
+        /// when they wrap around the ring. Valid until the queue is modified
+        std::optional<std::array<std::span<const uint8_t>, 2>> readBytes(std::size_t n) {
+            if (n > remaining()) {
+                return std::nullopt;
+            }
+
+            auto const firstOffset = std::min(offset, spans[0].size());
+            auto const fromFirst = std::min(n, spans[0].size() - firstOffset);
+            auto const secondOffset = offset - firstOffset;
+
+            offset += n;
+            return std::array{
+                    spans[0].subspan(firstOffset, fromFirst),
+                    spans[1].subspan(secondOffset, n - fromFirst)
+            };
+        }
+
+        /// The next n bytes as one span. If they wrap around the ring the queue's bytes are moved in place first,
+        /// which invalidates spans returned by earlier reads
+        std::optional<std::span<const uint8_t>> readContiguous(std::size_t n) {
+            if (n > remaining()) {
+                return std::nullopt;
+            }
+
+            if (offset + n > spans[0].size()) {
+                queue.peekContiguous(offset + n);
+                spans = queue.readableSpans();
+            }
+
+            auto const bytes = spans[0].subspan(offset, n);
+            offset += n;
+            return bytes;
+        }
+
+        /// readContiguous as text
+        std::optional<std::string_view> readString(std::size_t n) {
+            auto const bytes = readContiguous(n);
+            if (!bytes) {
+                return std::nullopt;
+            }
+
+            return std::string_view(reinterpret_cast<char const *>(bytes->data()), bytes->size());
+        }
+
+        /// Moves the cursor past n bytes
+        bool skip(std::size_t n) {
+            if (n > remaining()) {
+                return false;
+            }
+
+            offset += n;
+            return true;
+        }
+
+    private:
+        ReadOnlyStreamQueue &queue;
+        // Refreshed whenever the queue is modified through the reader
+        std::array<std::span<const uint8_t>, 2> spans;
+        std::size_t offset = 0;
+        bool invalid = false;
+
+        /// Up to scratch.size() bytes from position at, in place if they don't wrap around the ring
+        std::span<const uint8_t> bytesAt(std::size_t at, std::span<uint8_t> scratch) const {
+            if (at + scratch.size() <= spans[0].size()) {
+                return spans[0].subspan(at, scratch.size());
+            }
+
+            std::size_t copied = 0;
+            for (auto span: spans) {
+                if (at >= span.size()) {
+                    at -= span.size();
+                    continue;
+                }
+
+                auto const count = std::min(span.size() - at, scratch.size() - copied);
+                std::memcpy(scratch.data() + copied, span.data() + at, count);
+                copied += count;
+                at = 0;
+            }
+
+            return scratch.first(copied);
+        }
+    };
+}
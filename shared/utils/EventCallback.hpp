@@ -2,12 +2,21 @@
 
 // taken from https://github.com/sc2ad/beatsaber-hook/blob/master/shared/utils/typedefs-wrappers.hpp
 
+#include <array>
+#include <cstdint>
 #include <unordered_set>
 #include <set>
 #include <functional>
 #include <shared_mutex>
 #include <memory>
 #include <mutex>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace SocketLib {
     template<template<typename> typename Container, typename Item>
@@ -20,171 +29,205 @@ namespace SocketLib {
         coll.size();
     };
 
-    template<class T>
-    struct AbstractFunction;
+    namespace detail {
+        // Identity of delegates holding a callable, copies share it so they can be unsubscribed
+        inline std::atomic_uintptr_t nextCallableId = 1;
+        // Instance of delegates holding a callable, so they never equal a function pointer
+        inline char callableInstance;
+
+        // Small per thread indices for per thread caches, handed out again after their thread exits
+        class CallbackThreadIndex {
+        public:
+            CallbackThreadIndex() {
+                std::unique_lock lock(mutex());
+                if (freeIndices().empty()) {
+                    value = nextIndex()++;
+                } else {
+                    value = freeIndices().back();
+                    freeIndices().pop_back();
+                }
+            }
 
-    template<typename R, typename T, typename... TArgs>
-    struct AbstractFunction<R(T *, TArgs...)> {
-        virtual T *instance() const = 0;
+            ~CallbackThreadIndex() {
+                std::unique_lock lock(mutex());
+                freeIndices().push_back(value);
+            }
 
-        [[nodiscard]] virtual void *ptr() const = 0;
+            CallbackThreadIndex(CallbackThreadIndex const &) = delete;
+            CallbackThreadIndex &operator=(CallbackThreadIndex const &) = delete;
 
-        virtual R operator()(TArgs... args) const noexcept = 0;
+            uint32_t value;
 
-        virtual ~AbstractFunction() = default;
-    };
+        private:
+            // Function statics, a thread exiting during static destruction still finds them
+            static std::mutex &mutex() {
+                static auto *instance = new std::mutex();
+                return *instance;
+            }
 
-    template<class T>
-    struct FunctionWrapper;
+            static std::vector<uint32_t> &freeIndices() {
+                static auto *instance = new std::vector<uint32_t>();
+                return *instance;
+            }
 
-    template<typename R, typename... TArgs>
-    struct FunctionWrapper<R (*)(TArgs...)> : AbstractFunction<R(void *, TArgs...)> {
-        [[nodiscard]] void *instance() const override {
-            return nullptr;
-        }
+            static uint32_t &nextIndex() {
+                static uint32_t instance = 0;
+                return instance;
+            }
+        };
 
-        [[nodiscard]] void *ptr() const override {
-            return reinterpret_cast<void *>(held);
+        inline uint32_t callbackThreadIndex() {
+            thread_local CallbackThreadIndex const index;
+            return index.value;
         }
+    }
 
-        R (*held)(TArgs...);
+    template<class T>
+    struct ThinVirtualLayer;
 
-        template<class F>
-        FunctionWrapper(F &&f) : held(f) {}
+}
 
-        R operator()(TArgs... args) const noexcept override {
-            if constexpr (std::is_same_v<R, void>) {
-                held(args...);
-            } else {
-                return held(args...);
-            }
-        }
-    };
+template<typename R, typename T, typename... TArgs>
+struct std::hash<SocketLib::ThinVirtualLayer<R(T *, TArgs...)>>;
+
+namespace SocketLib {
 
+    /// A delegate stored by value. The callable lives in an inline buffer and is invoked through one
+    /// function pointer, nothing is allocated or reference counted.
+    /// Delegates compare by instance and function, or by construction for other callables
     template<typename R, typename T, typename... TArgs>
-    struct FunctionWrapper<R (T::*)(TArgs...)> : AbstractFunction<R(void *, TArgs...)> {
-        void *instance() const override {
-            return _instance;
-        }
+    struct ThinVirtualLayer<R(T *, TArgs...)> {
+        friend struct std::hash<ThinVirtualLayer<R(T *, TArgs...)>>;
 
-        void *ptr() const override {
-            using fptr = R (T::*)(TArgs...);
-            union dat {
-                fptr wrapper;
-                void *data;
-            };
-            dat d{.wrapper = held};
-            return d.data;
-        }
+        // Fits a std::function or a lambda capturing six pointers
+        constexpr static std::size_t INLINE_CAPACITY = 6 * sizeof(void *);
 
-        R (T::*held)(TArgs...);
+    private:
+        using Invoker = R (*)(void const *storage, TArgs... args);
+        // Copies source into destination, or destroys destination if source is null
+        using Manager = void (*)(void *destination, void const *source);
 
-        T *_instance;
+        alignas(std::max_align_t) std::byte storage[INLINE_CAPACITY];
+        // Set for plain functions, called directly instead of through invoker
+        R (*function)(TArgs...) = nullptr;
+        Invoker invoker = nullptr;
+        // Null if the callable is trivially copyable, storage is copied as bytes then
+        Manager manager = nullptr;
 
-        template<class F>
-        FunctionWrapper(F &&f, T *inst) : held(f), _instance(inst) {}
+        void *_instance;
+        void *_ptr;
 
-        R operator()(TArgs... args) const noexcept override {
-            if constexpr (std::is_same_v<R, void>) {
-                (reinterpret_cast<T *>(_instance)->*held)(args...);
-            } else {
-                return (reinterpret_cast<T *>(_instance)->*held)(args...);
-            }
-        }
-    };
+        template<typename F>
+        void store(F const &f) {
+            static_assert(sizeof(F) <= INLINE_CAPACITY, "Callable too large for ThinVirtualLayer, capture less");
+            static_assert(alignof(F) <= alignof(std::max_align_t), "Callable over aligned for ThinVirtualLayer");
 
-    template<typename R, typename... TArgs>
-    struct FunctionWrapper<std::function<R(TArgs...)>> : AbstractFunction<R(void *, TArgs...)> {
-        [[nodiscard]] void *instance() const override {
-            return nullptr;
-        }
+            new(storage) F(f);
+            invoker = [](void const *data, TArgs... args) -> R {
+                return (*static_cast<F const *>(data))(std::forward<TArgs>(args)...);
+            };
 
-        [[nodiscard]] void *ptr() const override {
-            return handle;
+            if constexpr (!std::is_trivially_copyable_v<F>) {
+                manager = [](void *destination, void const *source) {
+                    if (source != nullptr) {
+                        new(destination) F(*static_cast<F const *>(source));
+                    } else {
+                        static_cast<F *>(destination)->~F();
+                    }
+                };
+            }
         }
 
-        std::function<R(TArgs...)> const held;
-        void *handle;
-
-        FunctionWrapper(std::function<R(TArgs...)> const &f) : held(f),
-                                                               handle(const_cast<void *>(reinterpret_cast<const void *>(&f))) {}
+        void copyFrom(ThinVirtualLayer const &other) {
+            function = other.function;
+            invoker = other.invoker;
+            manager = other.manager;
+            _instance = other._instance;
+            _ptr = other._ptr;
 
-        R operator()(TArgs... args) const noexcept override {
-            if constexpr (std::is_same_v<R, void>) {
-                held(args...);
+            if (manager != nullptr) {
+                manager(storage, other.storage);
             } else {
-                return held(args...);
+                std::memcpy(storage, other.storage, INLINE_CAPACITY);
             }
         }
-    };
 
-}
-namespace std {
-    template<typename R, typename T, typename... TArgs>
-    struct hash<SocketLib::AbstractFunction < R(T * , TArgs...)>> {
-    std::size_t operator()(const SocketLib::AbstractFunction<R(T *, TArgs...)> &obj) const noexcept {
-        auto seed = std::hash<void *>{}(obj.instance());
-        return seed ^ std::hash<void *>{}(reinterpret_cast<void *>(obj.ptr())) + 0x9e3779b9 + (seed << 6) +
-                      (seed >> 2);
-    }
-};
-}
-
-namespace SocketLib {
-    template<typename R, typename T, typename... TArgs>
-    bool operator==(const AbstractFunction<R(T *, TArgs...)> &a, const AbstractFunction<R(T *, TArgs...)> &b) {
-        return a.instance() == b.instance() && a.ptr() == b.ptr();
-    }
-
-    template<typename R, typename T, typename... TArgs>
-    bool operator<(const AbstractFunction<R(T *, TArgs...)> &a, const AbstractFunction<R(T *, TArgs...)> &b) {
-        return a.ptr() < b.ptr();
-    }
-
-    template<class T>
-    struct ThinVirtualLayer;
-
-}
+        void destroy() {
+            if (manager != nullptr) {
+                manager(storage, nullptr);
+            }
+        }
 
-template<typename R, typename T, typename... TArgs>
-struct std::hash<SocketLib::ThinVirtualLayer<R(T *, TArgs...)>>;
+    public:
+        ThinVirtualLayer(R (*ptr)(TArgs...)) : function(ptr), _instance(nullptr), _ptr(reinterpret_cast<void *>(ptr)) {}
 
-namespace SocketLib {
+        template<class F, typename Q>
+        ThinVirtualLayer(F &&f, Q *inst) : _instance(inst) {
+            using fptr = R (Q::*)(TArgs...);
+            union dat {
+                fptr wrapper;
+                void *data;
+            };
+            dat d{.wrapper = f};
+            _ptr = d.data;
 
+            fptr held = f;
+            store([held, inst](TArgs... args) -> R {
+                return (inst->*held)(std::forward<TArgs>(args)...);
+            });
+        }
 
-    template<typename R, typename T, typename... TArgs>
-    struct ThinVirtualLayer<R(T *, TArgs...)> {
-        friend struct std::hash<ThinVirtualLayer<R(T *, TArgs...)>>;
-    private:
-        std::shared_ptr<AbstractFunction<R(T *, TArgs...)>> func;
+        template<class F>
+        requires(!std::is_same_v<std::remove_cvref_t<F>, ThinVirtualLayer> &&
+                 // Functions of the exact signature compare by address instead
+                 !(std::is_function_v<std::remove_reference_t<F>> && std::is_convertible_v<F, R (*)(TArgs...)>) &&
+                 std::is_invocable_r_v<R, F &, TArgs...>)
+        ThinVirtualLayer(F &&f) : _instance(&detail::callableInstance),
+                                  _ptr(reinterpret_cast<void *>(detail::nextCallableId.fetch_add(1, std::memory_order_relaxed))) {
+            store(std::decay_t<F>(std::forward<F>(f)));
+        }
 
-    public:
-        ThinVirtualLayer(R (*ptr)(TArgs...)) : func(new FunctionWrapper<R (*)(TArgs...)>(ptr)) {}
+        ThinVirtualLayer(ThinVirtualLayer const &other) {
+            copyFrom(other);
+        }
 
-        template<class F, typename Q>
-        ThinVirtualLayer(F &&f, Q *inst) : func(new FunctionWrapper<R (Q::*)(TArgs...)>(f, inst)) {}
+        ThinVirtualLayer &operator=(ThinVirtualLayer const &other) {
+            if (this != &other) {
+                destroy();
+                copyFrom(other);
+            }
+            return *this;
+        }
 
-        template<class F>
-        ThinVirtualLayer(F &&f) : func(new FunctionWrapper<std::function<R(TArgs...)>>(f)) {}
+        ~ThinVirtualLayer() {
+            destroy();
+        }
 
-        R operator()(TArgs... args) const noexcept {
-            (*func)(args...);
+        R operator()(TArgs... args) const {
+            if (function != nullptr) {
+                return function(std::forward<TArgs>(args)...);
+            }
+            return invoker(storage, std::forward<TArgs>(args)...);
         }
 
         void *instance() const {
-            return func->instance();
+            return _instance;
         }
 
         void *ptr() const {
-            return func->ptr();
+            return _ptr;
         }
 
-        bool operator==(const ThinVirtualLayer<R(T *, TArgs...)> other) const {
-            return *func == (*other.func);
+        bool operator==(ThinVirtualLayer const &other) const {
+            return _instance == other._instance && _ptr == other._ptr;
         }
 
-        bool operator<(const ThinVirtualLayer<R(T *, TArgs...)> other) const {
-            return *func < *other.func;
+        // By instance too, otherwise one member function on two instances is one element of a set
+        bool operator<(ThinVirtualLayer const &other) const {
+            if (_ptr != other._ptr) {
+                return std::less<void *>()(_ptr, other._ptr);
+            }
+            return std::less<void *>()(_instance, other._instance);
         }
     };
 
@@ -194,7 +237,8 @@ namespace std {
     template<typename R, typename T, typename... TArgs>
     struct hash<SocketLib::ThinVirtualLayer < R(T * , TArgs...)>> {
     std::size_t operator()(const SocketLib::ThinVirtualLayer<R(T *, TArgs...)> &obj) const noexcept {
-        return std::hash<SocketLib::AbstractFunction<R(T * , TArgs...)>>{}(*obj.func);
+        auto seed = std::hash<void *>{}(obj._instance);
+        return seed ^ std::hash<void *>{}(obj._ptr) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
     }
 };
 }
@@ -394,6 +438,212 @@ namespace SocketLib::Utils {
         }
     };
 
+    // Copy on write implementation
+    // Invoke iterates an immutable snapshot without locks, every subscribe or unsubscribe copies it.
+    // Suits callbacks invoked far more often than they change, like the ones invoked per read.
+    // Each thread keeps its own reference to the snapshot it last ran and only checks a version counter,
+    // so an invoke writes nothing shared. A thread takes the mutex once after every change to pick up the new
+    // snapshot. Threads past CACHED_THREADS, and invokes nested in a handler of the same callback after a
+    // change, take the mutex every time instead. A thread holds on to the last snapshot it ran, with copies of
+    // its handlers, until it invokes again or the callback is destroyed
+    template<template<typename> typename Container, typename ...TArgs> requires(
+    is_valid_container<Container, ThinVirtualLayer<void(void *, TArgs...)>>)
+    class CopyOnWriteEventCallback {
+    public:
+        // Threads invoking without the mutex, indices are reused once a thread exits
+        constexpr static std::size_t CACHED_THREADS = 64;
+
+    private:
+        using functionType = ThinVirtualLayer<void(void *, TArgs...)>;
+        using Snapshot = std::vector<functionType>;
+
+        // Only read and written by the thread with its index, handlers keep the snapshot they run alive
+        struct ThreadCache {
+            std::shared_ptr<Snapshot const> snapshot;
+            uint64_t version = 0;
+            // Invokes of this callback on the stack, the snapshot can't be replaced under them
+            uint32_t depth = 0;
+        };
+
+        // Only touched by writers, keeps the container's ordering and uniqueness
+        Container<functionType> callbacks;
+        mutable std::mutex mutex;
+
+        // Guarded by mutex, null while there are no callbacks
+        std::shared_ptr<Snapshot const> latest;
+        // Bumped under mutex after latest is replaced
+        std::atomic_uint64_t version = 0;
+        std::atomic_size_t count = 0;
+
+        mutable std::array<ThreadCache, CACHED_THREADS> caches;
+
+        std::shared_ptr<Snapshot const> loadLatest() const {
+            std::unique_lock lock(mutex);
+            return latest;
+        }
+
+        template<typename F>
+        void forEach(F &&f) const {
+            if (count.load(std::memory_order_relaxed) == 0) {
+                return;
+            }
+
+            auto const published = version.load(std::memory_order_acquire);
+            auto const index = detail::callbackThreadIndex();
+            auto *cache = index < CACHED_THREADS ? &caches[index] : nullptr;
+
+            if (cache != nullptr && (cache->version == published || cache->depth == 0)) {
+                if (cache->version != published) {
+                    std::unique_lock lock(mutex);
+                    cache->snapshot = latest;
+                    cache->version = version.load(std::memory_order_relaxed);
+                }
+
+                struct Depth {
+                    uint32_t &depth;
+
+                    explicit Depth(uint32_t &depth) : depth(depth) {
+                        depth++;
+                    }
+
+                    ~Depth() {
+                        depth--;
+                    }
+                } const nested(cache->depth);
+
+                if (cache->snapshot != nullptr) {
+                    for (auto &callback: *cache->snapshot) {
+                        f(callback);
+                    }
+                }
+                return;
+            }
+
+            if (auto const current = loadLatest(); current != nullptr) {
+                for (auto &callback: *current) {
+                    f(callback);
+                }
+            }
+        }
+
+        template<typename F>
+        void modify(F &&f) {
+            std::unique_lock lock(mutex);
+            f(callbacks);
+
+            latest = callbacks.empty() ? nullptr
+                                       : std::make_shared<Snapshot const>(callbacks.begin(), callbacks.end());
+            count.store(callbacks.size(), std::memory_order_relaxed);
+            version.fetch_add(1, std::memory_order_release);
+        }
+
+    public:
+        CopyOnWriteEventCallback() = default;
+        CopyOnWriteEventCallback(CopyOnWriteEventCallback const &) = delete;
+        CopyOnWriteEventCallback &operator=(CopyOnWriteEventCallback const &) = delete;
+
+        void invoke(TArgs... args) const {
+            forEach([&](functionType const &callback) {
+                callback(args...);
+            });
+        }
+
+        template<typename F>
+        void invokeError(TArgs... args, F &&exceptionHandle) const {
+            forEach([&](functionType const &callback) {
+                try {
+                    callback(args...);
+                } catch (std::exception const &e) {
+                    std::forward<F>(exceptionHandle)(e);
+                }
+            });
+        }
+
+        CopyOnWriteEventCallback &operator+=(ThinVirtualLayer<void(void *, TArgs...)> callback) {
+            addCallback(std::move(callback));
+            return *this;
+        }
+
+        CopyOnWriteEventCallback &operator-=(void (*callback)(TArgs...)) {
+            removeCallback(callback);
+            return *this;
+        }
+
+        CopyOnWriteEventCallback &operator-=(ThinVirtualLayer<void(void *, TArgs...)> callback) {
+            removeCallback(callback);
+            return *this;
+        }
+
+        template<typename T>
+        CopyOnWriteEventCallback &operator-=(void (T::*callback)(TArgs...)) {
+            removeCallback(callback);
+            return *this;
+        }
+
+        void addCallback(ThinVirtualLayer<void(void *, TArgs...)> const &callback) {
+            modify([&](auto &container) {
+                container.emplace(callback);
+            });
+        }
+
+        void addCallback(void (*callback)(TArgs...)) {
+            modify([&](auto &container) {
+                container.emplace(callback);
+            });
+        }
+
+        // The instance provide here should have lifetime > calls to invoke.
+        // If the provided instance dies before this instance, or before invoke is called, invoke will crash.
+        template<typename T>
+        void addCallback(void (T::*callback)(TArgs...), T *inst) {
+            modify([&](auto &container) {
+                container.emplace(callback, inst);
+            });
+        }
+
+        void removeCallback(void (*callback)(TArgs...)) {
+            modify([&](auto &container) {
+                container.erase(callback);
+            });
+        }
+
+        void removeCallback(ThinVirtualLayer<void(void *, TArgs...)> const &callback) {
+            modify([&](auto &container) {
+                container.erase(callback);
+            });
+        }
+
+        template<typename T>
+        void removeCallback(void (T::*callback)(TArgs...)) {
+            union dat {
+                decltype(callback) wrapper;
+                void *data;
+            };
+            dat d{.wrapper = callback};
+
+            // Every instance's, like the other implementations
+            modify([&](auto &container) {
+                for (auto itr = container.begin(); itr != container.end();) {
+                    itr = itr->ptr() == d.data ? container.erase(itr) : std::next(itr);
+                }
+            });
+        }
+
+        auto size() const {
+            return count.load(std::memory_order_relaxed);
+        }
+
+        void clear() {
+            modify([](auto &container) {
+                container.clear();
+            });
+        }
+
+        bool empty() const {
+            return count.load(std::memory_order_relaxed) == 0;
+        }
+    };
+
 
     template<typename Item>
     using default_ordered_set = std::set<Item>;
@@ -409,4 +659,8 @@ namespace SocketLib::Utils {
     template<typename ...TArgs>
     using UnorderedEventCallback = ThreadSafeEventCallback<default_unordered_set, TArgs...>;
 
+    // For callbacks on hot paths which rarely change
+    template<typename ...TArgs>
+    using SnapshotEventCallback = CopyOnWriteEventCallback<default_ordered_set, TArgs...>;
+
 }
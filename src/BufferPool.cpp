@@ -0,0 +1,350 @@
+#include "BufferPool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <new>
+
+using namespace SocketLib;
+
+namespace {
+    std::atomic<BufferAllocator*> defaultAllocator = nullptr;
+    std::atomic_uint64_t nextPoolId = 1;
+
+    constexpr std::size_t ALIGNMENT = alignof(std::max_align_t);
+
+    constexpr std::size_t alignUp(std::size_t size) {
+        return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    class HeapAllocator final : public BufferAllocator {
+    public:
+        byte* allocate(std::size_t size) override {
+            return static_cast<byte*>(::operator new(size, std::nothrow));
+        }
+
+        void deallocate(byte* data, std::size_t) override {
+            ::operator delete(data);
+        }
+    };
+
+    constexpr std::size_t blockSize(std::size_t sizeClass) {
+        return BufferPool::MIN_BLOCK_SIZE << sizeClass;
+    }
+
+    /// Blocks a thread may hold per class before handing half of them back
+    constexpr std::size_t cacheLimit(std::size_t sizeClass) {
+        return std::clamp<std::size_t>(128 * 1024 / blockSize(sizeClass), 2, 64);
+    }
+}
+
+struct BufferPool::Central {
+    struct SizeClass {
+        std::mutex mutex;
+        std::vector<byte*> freeBlocks;
+    };
+
+    Central(BufferAllocator& upstream, std::size_t slabSize) : upstream(upstream), slabSize(slabSize) {}
+
+    ~Central() {
+        for (auto [slab, size]: slabs) {
+            upstream.deallocate(slab, size);
+        }
+    }
+
+    /// Moves up to count free blocks into blocks, carving a new slab if there are none
+    void refill(std::size_t sizeClass, std::vector<byte*>& blocks, std::size_t count) {
+        auto& freeList = classes[sizeClass];
+        std::unique_lock lock(freeList.mutex);
+
+        if (freeList.freeBlocks.empty()) {
+            auto const size = blockSize(sizeClass);
+            auto const slabBytes = std::max(slabSize, size);
+
+            auto* slab = upstream.allocate(slabBytes);
+            if (slab == nullptr) {
+                return;
+            }
+
+            {
+                std::unique_lock slabLock(slabsMutex);
+                slabs.emplace_back(slab, slabBytes);
+            }
+            this->slabCount.fetch_add(1, std::memory_order_relaxed);
+            this->slabBytes.fetch_add(slabBytes, std::memory_order_relaxed);
+
+            for (std::size_t offset = 0; offset + size <= slabBytes; offset += size) {
+                freeList.freeBlocks.push_back(slab + offset);
+            }
+        }
+
+        count = std::min(count, freeList.freeBlocks.size());
+        blocks.insert(blocks.end(), freeList.freeBlocks.end() - (long) count, freeList.freeBlocks.end());
+        freeList.freeBlocks.resize(freeList.freeBlocks.size() - count);
+
+        refills.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Takes the last count blocks of blocks back
+    void release(std::size_t sizeClass, std::vector<byte*>& blocks, std::size_t count) {
+        auto& freeList = classes[sizeClass];
+        {
+            std::unique_lock lock(freeList.mutex);
+            freeList.freeBlocks.insert(freeList.freeBlocks.end(), blocks.end() - (long) count, blocks.end());
+        }
+        blocks.resize(blocks.size() - count);
+
+        flushes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t const id = nextPoolId.fetch_add(1, std::memory_order_relaxed);
+    BufferAllocator& upstream;
+    std::size_t const slabSize;
+
+    std::array<SizeClass, CLASS_COUNT> classes;
+
+    std::mutex slabsMutex;
+    std::vector<std::pair<byte*, std::size_t>> slabs;
+
+    std::atomic_size_t slabCount = 0;
+    std::atomic_size_t slabBytes = 0;
+    std::atomic_size_t refills = 0;
+    std::atomic_size_t flushes = 0;
+    std::atomic_size_t oversizeAllocations = 0;
+    std::atomic_size_t oversizeBytes = 0;
+};
+
+namespace {
+    /// Free blocks this thread holds for each pool it used
+    struct ThreadCache {
+        struct Entry {
+            uint64_t poolId;
+            // The pool may be destroyed first, its blocks are dropped then
+            std::weak_ptr<BufferPool::Central> central;
+            std::array<std::vector<byte*>, BufferPool::CLASS_COUNT> blocks;
+        };
+
+        std::vector<std::unique_ptr<Entry>> entries;
+        Entry* last = nullptr;
+
+        Entry& get(std::shared_ptr<BufferPool::Central> const& central) {
+            if (last != nullptr && last->poolId == central->id) {
+                return *last;
+            }
+
+            auto it = std::find_if(entries.begin(), entries.end(), [&](auto const& entry) {
+                return entry->poolId == central->id;
+            });
+
+            if (it == entries.end()) {
+                // Forget pools that are gone, ids are never reused
+                std::erase_if(entries, [](auto const& entry) { return entry->central.expired(); });
+
+                auto& entry = entries.emplace_back(std::make_unique<Entry>());
+                entry->poolId = central->id;
+                entry->central = central;
+                it = entries.end() - 1;
+            }
+
+            last = it->get();
+            return *last;
+        }
+
+        static void flush(Entry& entry) {
+            auto central = entry.central.lock();
+            if (!central) {
+                return;
+            }
+
+            for (std::size_t sizeClass = 0; sizeClass < BufferPool::CLASS_COUNT; sizeClass++) {
+                auto& blocks = entry.blocks[sizeClass];
+                if (!blocks.empty()) {
+                    central->release(sizeClass, blocks, blocks.size());
+                }
+            }
+        }
+
+        ~ThreadCache();
+    };
+
+    thread_local ThreadCache threadCache;
+    // Buffers freed by thread_local destructors running after the cache's go straight to the pool
+    thread_local bool threadCacheDestroyed = false;
+
+    ThreadCache::~ThreadCache() {
+        for (auto& entry: entries) {
+            flush(*entry);
+        }
+        threadCacheDestroyed = true;
+    }
+}
+
+BufferAllocator& BufferAllocator::heap() {
+    // Never destroyed, buffers may be freed during static destruction
+    static auto* allocator = new HeapAllocator();
+    return *allocator;
+}
+
+BufferAllocator& BufferAllocator::getDefault() {
+    auto* allocator = defaultAllocator.load(std::memory_order_acquire);
+    if (allocator != nullptr) {
+        return *allocator;
+    }
+
+    static auto* pool = new BufferPool();
+    return *pool;
+}
+
+void BufferAllocator::setDefault(BufferAllocator& allocator) {
+    defaultAllocator.store(&allocator, std::memory_order_release);
+}
+
+ArenaAllocator::ArenaAllocator(std::span<byte> memory) {
+    // Every allocation is a multiple of ALIGNMENT from here
+    auto const misalignment = reinterpret_cast<std::uintptr_t>(memory.data()) % ALIGNMENT;
+    auto const skip = std::min(misalignment == 0 ? 0 : ALIGNMENT - misalignment, memory.size());
+
+    this->memory = memory.subspan(skip);
+}
+
+byte* ArenaAllocator::allocate(std::size_t size) {
+    size = alignUp(size);
+
+    auto start = offset.load(std::memory_order_relaxed);
+    do {
+        if (size > memory.size() - start) {
+            return nullptr;
+        }
+    } while (!offset.compare_exchange_weak(start, start + size, std::memory_order_relaxed));
+
+    return memory.data() + start;
+}
+
+BufferPool::BufferPool(BufferAllocator& upstream, std::size_t slabSize)
+        : central(std::make_shared<Central>(upstream, slabSize)) {}
+
+BufferPool::~BufferPool() {
+    flushThreadCache();
+}
+
+std::size_t BufferPool::sizeClass(std::size_t size) {
+    if (size <= MIN_BLOCK_SIZE) {
+        return 0;
+    }
+    if (size > MAX_BLOCK_SIZE) {
+        return CLASS_COUNT;
+    }
+
+    return std::bit_width(size - 1) - std::bit_width(MIN_BLOCK_SIZE - 1);
+}
+
+byte* BufferPool::allocate(std::size_t size) {
+    auto const sizeClass = BufferPool::sizeClass(size);
+
+    if (sizeClass == CLASS_COUNT) {
+        central->oversizeAllocations.fetch_add(1, std::memory_order_relaxed);
+        central->oversizeBytes.fetch_add(size, std::memory_order_relaxed);
+        return central->upstream.allocate(size);
+    }
+
+    if (threadCacheDestroyed) {
+        std::vector<byte*> block;
+        central->refill(sizeClass, block, 1);
+        return block.empty() ? nullptr : block.front();
+    }
+
+    auto& blocks = threadCache.get(central).blocks[sizeClass];
+    if (blocks.empty()) {
+        central->refill(sizeClass, blocks, std::max<std::size_t>(cacheLimit(sizeClass) / 2, 1));
+
+        if (blocks.empty()) {
+            return nullptr;
+        }
+    }
+
+    auto* block = blocks.back();
+    blocks.pop_back();
+    return block;
+}
+
+void BufferPool::deallocate(byte* data, std::size_t size) {
+    if (data == nullptr) {
+        return;
+    }
+
+    auto const sizeClass = BufferPool::sizeClass(size);
+
+    if (sizeClass == CLASS_COUNT) {
+        central->oversizeBytes.fetch_sub(size, std::memory_order_relaxed);
+        central->upstream.deallocate(data, size);
+        return;
+    }
+
+    if (threadCacheDestroyed) {
+        std::vector<byte*> block{data};
+        central->release(sizeClass, block, 1);
+        return;
+    }
+
+    auto& blocks = threadCache.get(central).blocks[sizeClass];
+    blocks.push_back(data);
+
+    if (blocks.size() > cacheLimit(sizeClass)) {
+        central->release(sizeClass, blocks, blocks.size() / 2);
+    }
+}
+
+void BufferPool::flushThreadCache() {
+    if (threadCacheDestroyed) {
+        return;
+    }
+
+    ThreadCache::flush(threadCache.get(central));
+}
+
+BufferPoolStats BufferPool::getStats() const {
+    BufferPoolStats stats{
+            .slabs = central->slabCount.load(std::memory_order_relaxed),
+            .slabBytes = central->slabBytes.load(std::memory_order_relaxed),
+            .refills = central->refills.load(std::memory_order_relaxed),
+            .flushes = central->flushes.load(std::memory_order_relaxed),
+            .oversizeAllocations = central->oversizeAllocations.load(std::memory_order_relaxed),
+            .oversizeBytes = central->oversizeBytes.load(std::memory_order_relaxed)
+    };
+
+    for (auto& freeList: central->classes) {
+        std::unique_lock lock(freeList.mutex);
+        stats.freeBlocks += freeList.freeBlocks.size();
+    }
+
+    return stats;
+}
+
+namespace {
+    // Stored in front of queue blocks, moodycamel frees without a size
+    struct QueueBlockHeader {
+        BufferAllocator* allocator;
+        std::size_t size;
+    };
+    static_assert(sizeof(QueueBlockHeader) <= ALIGNMENT);
+}
+
+void* SocketLib::detail::pooledQueueMalloc(std::size_t size) {
+    auto& allocator = BufferAllocator::getDefault();
+    auto* block = allocator.allocate(size + ALIGNMENT);
+    if (block == nullptr) {
+        return nullptr;
+    }
+
+    new(block) QueueBlockHeader{&allocator, size + ALIGNMENT};
+    return block + ALIGNMENT;
+}
+
+void SocketLib::detail::pooledQueueFree(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    auto* block = static_cast<byte*>(ptr) - ALIGNMENT;
+    auto* header = reinterpret_cast<QueueBlockHeader*>(block);
+    header->allocator->deallocate(block, header->size);
+}
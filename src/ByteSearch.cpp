@@ -0,0 +1,153 @@
+#include "ByteSearch.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOCKETLIB_X86_SIMD
+#endif
+
+using namespace SocketLib;
+using namespace SocketLib::Utils;
+
+#ifdef SOCKETLIB_X86_SIMD
+namespace {
+    // Both check an unaligned first vector, since most lines end within it, then continue from
+    // the next aligned address and finish with a last vector overlapping bytes already checked
+
+    __attribute__((target("sse2")))
+    std::size_t findSse2(uint8_t const* data, std::size_t size, uint8_t value) {
+        if (size < 16) {
+            for (std::size_t i = 0; i < size; i++) {
+                if (data[i] == value) {
+                    return i;
+                }
+            }
+            return BYTE_NOT_FOUND;
+        }
+
+        auto const needle = _mm_set1_epi8(static_cast<char>(value));
+        auto const matches = [&](std::size_t i) __attribute__((target("sse2"))) {
+            auto const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i));
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+        };
+
+        if (auto const mask = matches(0); mask != 0) {
+            return __builtin_ctz(mask);
+        }
+
+        std::size_t i = 16 - (reinterpret_cast<uintptr_t>(data) & 15);
+        for (; i + 16 <= size; i += 16) {
+            if (auto const mask = matches(i); mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+
+        if (i < size) {
+            if (auto const mask = matches(size - 16); mask != 0) {
+                return size - 16 + __builtin_ctz(mask);
+            }
+        }
+        return BYTE_NOT_FOUND;
+    }
+
+    __attribute__((target("avx2")))
+    std::size_t findAvx2(uint8_t const* data, std::size_t size, uint8_t value) {
+        if (size < 32) {
+            return findSse2(data, size, value);
+        }
+
+        auto const needle = _mm256_set1_epi8(static_cast<char>(value));
+        auto const compare = [&](std::size_t i) __attribute__((target("avx2"))) {
+            return _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + i)), needle);
+        };
+        auto const mask = [](__m256i compared) __attribute__((target("avx2"))) {
+            return static_cast<uint32_t>(_mm256_movemask_epi8(compared));
+        };
+
+        if (auto const first = mask(compare(0)); first != 0) {
+            return __builtin_ctz(first);
+        }
+
+        std::size_t i = 32 - (reinterpret_cast<uintptr_t>(data) & 31);
+        // Two vectors per iteration with a single branch
+        for (; i + 64 <= size; i += 64) {
+            auto const low = compare(i);
+            auto const high = compare(i + 32);
+            auto const either = _mm256_or_si256(low, high);
+            if (_mm256_testz_si256(either, either) != 0) {
+                continue;
+            }
+
+            if (auto const lowMask = mask(low); lowMask != 0) {
+                return i + __builtin_ctz(lowMask);
+            }
+            return i + 32 + __builtin_ctz(mask(high));
+        }
+
+        for (; i + 32 <= size; i += 32) {
+            if (auto const found = mask(compare(i)); found != 0) {
+                return i + __builtin_ctz(found);
+            }
+        }
+
+        if (i < size) {
+            if (auto const found = mask(compare(size - 32)); found != 0) {
+                return size - 32 + __builtin_ctz(found);
+            }
+        }
+        return BYTE_NOT_FOUND;
+    }
+
+#ifndef __GLIBC__
+    ByteSearch::FindFn selectFind() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return findAvx2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return findSse2;
+        }
+        return ByteSearch::findPortable;
+    }
+#endif
+}
+#endif
+
+std::size_t ByteSearch::findPortable(uint8_t const* data, std::size_t size, uint8_t value) {
+    if (size == 0) {
+        return BYTE_NOT_FOUND;
+    }
+
+    auto const* found = static_cast<uint8_t const*>(std::memchr(data, value, size));
+    return found == nullptr ? BYTE_NOT_FOUND : static_cast<std::size_t>(found - data);
+}
+
+ByteSearch::FindFn ByteSearch::sse2() {
+#ifdef SOCKETLIB_X86_SIMD
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") ? findSse2 : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+ByteSearch::FindFn ByteSearch::avx2() {
+#ifdef SOCKETLIB_X86_SIMD
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? findAvx2 : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+std::size_t Utils::findByte(std::span<const uint8_t> bytes, uint8_t value) {
+    // glibc's memchr already picks an AVX2 or EVEX version for the CPU and beats ours on short lines
+#if defined(SOCKETLIB_X86_SIMD) && !defined(__GLIBC__)
+    // Picked once, the CPU doesn't change
+    static ByteSearch::FindFn const find = selectFind();
+    return find(bytes.data(), bytes.size(), value);
+#else
+    return ByteSearch::findPortable(bytes.data(), bytes.size(), value);
+#endif
+}
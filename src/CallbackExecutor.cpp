@@ -0,0 +1,218 @@
+#include "CallbackExecutor.hpp"
+#include "SocketLogger.hpp"
+
+#include <algorithm>
+
+using namespace SocketLib;
+
+namespace {
+    // Worker the current thread is, so submits from callbacks stay on the same queue
+    thread_local CallbackExecutor const* currentExecutor = nullptr;
+    thread_local std::size_t currentWorker = 0;
+
+    // Tasks a strand runs before it yields its thread to others
+    constexpr std::size_t STRAND_BATCH = 16;
+}
+
+CallbackExecutor::CallbackExecutor(Logger &logger, std::size_t threadCount, std::size_t maxQueued)
+        : logger(logger), maxQueued(std::max<std::size_t>(maxQueued, 1)) {
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    for (std::size_t i = 0; i < threadCount; i++) {
+        workers.emplace_back(std::make_unique<Worker>());
+    }
+
+    // Started once every queue exists, workers steal from all of them
+    for (std::size_t i = 0; i < threadCount; i++) {
+        workers[i]->thread = std::thread(&CallbackExecutor::workerLoop, this, i);
+    }
+}
+
+CallbackExecutor::~CallbackExecutor() {
+    {
+        std::unique_lock lock(sleepMutex);
+        active = false;
+    }
+    wake.notify_all();
+
+    for (auto &worker: workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void CallbackExecutor::submit(WorkT work) {
+    // Bounded, the submitter pays for the backlog instead of it growing
+    if (queued.load(std::memory_order_relaxed) >= maxQueued) {
+        ranInline.fetch_add(1, std::memory_order_relaxed);
+        run(work);
+        return;
+    }
+
+    auto const index = currentExecutor == this ? currentWorker
+                                               : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+    // Counted before it is visible, so a worker taking it never decrements first
+    auto const depth = queued.fetch_add(1, std::memory_order_seq_cst) + 1;
+    auto highWater = queuedHighWater.load(std::memory_order_relaxed);
+    while (highWater < depth &&
+           !queuedHighWater.compare_exchange_weak(highWater, depth, std::memory_order_relaxed)) {}
+
+    auto &worker = *workers[index];
+    {
+        std::unique_lock lock(worker.mutex);
+        worker.tasks.emplace_back(std::move(work));
+    }
+
+    // Sleepers count themselves before checking queued, so either they see the task or we see them
+    if (sleeping.load(std::memory_order_seq_cst) > 0) {
+        std::unique_lock lock(sleepMutex);
+        wake.notify_one();
+    }
+}
+
+CallbackExecutorStats CallbackExecutor::getStats() const {
+    return {
+            queued.load(std::memory_order_relaxed),
+            queuedHighWater.load(std::memory_order_relaxed),
+            executed.load(std::memory_order_relaxed),
+            stolen.load(std::memory_order_relaxed),
+            ranInline.load(std::memory_order_relaxed)
+    };
+}
+
+void CallbackExecutor::run(WorkT const &work) {
+    invoke(work);
+    executed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CallbackExecutor::invoke(WorkT const &work) {
+    try {
+        work();
+    } catch (std::exception const &e) {
+        logger.fmtLog<LoggerLevel::ERROR>(EXECUTOR_LOG_TAG, "Callback threw: {}", e.what());
+    } catch (...) {
+        logger.writeLog<LoggerLevel::ERROR>(EXECUTOR_LOG_TAG, "Callback threw an unknown exception");
+    }
+}
+
+bool CallbackExecutor::tryTake(std::size_t index, WorkT &work) {
+    {
+        auto &own = *workers[index];
+        std::unique_lock lock(own.mutex);
+        if (!own.tasks.empty()) {
+            work = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // Steal the newest task of a busy queue, skipping queues someone else holds
+    for (std::size_t i = 1; i < workers.size(); i++) {
+        auto &victim = *workers[(index + i) % workers.size()];
+        std::unique_lock lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty()) {
+            continue;
+        }
+
+        work = std::move(victim.tasks.back());
+        victim.tasks.pop_back();
+        stolen.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+void CallbackExecutor::workerLoop(std::size_t index) {
+    currentExecutor = this;
+    currentWorker = index;
+
+    WorkT work;
+    while (true) {
+        if (tryTake(index, work)) {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            run(work);
+            work = nullptr;
+            continue;
+        }
+
+        std::unique_lock lock(sleepMutex);
+        sleeping.fetch_add(1, std::memory_order_seq_cst);
+
+        // A steal may have skipped a locked queue, so wake up now and then to look again
+        wake.wait_for(lock, std::chrono::milliseconds(100), [this] {
+            return queued.load(std::memory_order_seq_cst) > 0 || !active;
+        });
+
+        sleeping.fetch_sub(1, std::memory_order_relaxed);
+
+        // Finish whatever was queued before stopping
+        if (!active && queued.load(std::memory_order_seq_cst) == 0) {
+            return;
+        }
+    }
+}
+
+void Strand::post(WorkT work) {
+    {
+        std::unique_lock lock(mutex);
+        tasks.emplace_back(std::move(work));
+
+        if (scheduled || held) {
+            return;
+        }
+        scheduled = true;
+    }
+
+    executor.submit([self = shared_from_this()] {
+        self->drain();
+    });
+}
+
+void Strand::hold() {
+    std::unique_lock lock(mutex);
+    held = true;
+}
+
+void Strand::release() {
+    {
+        std::unique_lock lock(mutex);
+        held = false;
+
+        if (scheduled || tasks.empty()) {
+            return;
+        }
+        scheduled = true;
+    }
+
+    executor.submit([self = shared_from_this()] {
+        self->drain();
+    });
+}
+
+void Strand::drain() {
+    for (std::size_t i = 0; i < STRAND_BATCH; i++) {
+        WorkT work;
+        {
+            std::unique_lock lock(mutex);
+            if (tasks.empty()) {
+                scheduled = false;
+                return;
+            }
+
+            work = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        executor.invoke(work);
+    }
+
+    // Still scheduled, let other strands have the thread before continuing
+    executor.submit([self = shared_from_this()] {
+        self->drain();
+    });
+}
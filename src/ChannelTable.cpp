@@ -0,0 +1,80 @@
+#include "ChannelTable.hpp"
+#include "ChannelHandle.hpp"
+
+#include <algorithm>
+
+#include <sys/resource.h>
+
+using namespace SocketLib;
+
+namespace {
+    // 4M descriptors, a 32KB top level table. Handles store the descriptor in as many bits
+    constexpr std::size_t MAX_DESCRIPTORS = std::size_t(1) << ChannelHandle::DESCRIPTOR_BITS;
+
+    std::size_t descriptorLimit() {
+        rlimit limit{};
+        if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_max == RLIM_INFINITY) {
+            return MAX_DESCRIPTORS;
+        }
+
+        // The hard limit, the soft one may be raised later
+        return std::clamp<std::size_t>(limit.rlim_max, 1024, MAX_DESCRIPTORS);
+    }
+}
+
+ChannelTable::ChannelTable()
+        : chunkCount((descriptorLimit() + CHUNK_SIZE - 1) / CHUNK_SIZE),
+          chunks(std::make_unique<std::atomic<Slot *>[]>(chunkCount)) {}
+
+ChannelTable::~ChannelTable() {
+    for (std::size_t i = 0; i < chunkCount; i++) {
+        delete[] chunks[i].load(std::memory_order_relaxed);
+    }
+}
+
+bool ChannelTable::insert(int descriptor, Channel *channel) {
+    auto const index = static_cast<std::size_t>(descriptor) / CHUNK_SIZE;
+    if (descriptor < 0 || index >= chunkCount) {
+        return false;
+    }
+
+    auto *chunk = chunks[index].load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+        // Value initialized, every slot starts null
+        auto *newChunk = new Slot[CHUNK_SIZE]();
+
+        if (chunks[index].compare_exchange_strong(chunk, newChunk, std::memory_order_acq_rel)) {
+            chunk = newChunk;
+        } else {
+            // Someone else was first, chunk now holds theirs
+            delete[] newChunk;
+        }
+    }
+
+    Channel *expected = nullptr;
+    if (!chunk[descriptor % CHUNK_SIZE].compare_exchange_strong(expected, channel, std::memory_order_acq_rel)) {
+        return false;
+    }
+
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    auto highest = highestDescriptor.load(std::memory_order_relaxed);
+    while (highest < descriptor &&
+           !highestDescriptor.compare_exchange_weak(highest, descriptor, std::memory_order_acq_rel)) {}
+
+    return true;
+}
+
+Channel *ChannelTable::remove(int descriptor) {
+    auto *chunk = findChunk(descriptor);
+    if (chunk == nullptr) {
+        return nullptr;
+    }
+
+    auto *channel = chunk[descriptor % CHUNK_SIZE].exchange(nullptr, std::memory_order_acq_rel);
+    if (channel != nullptr) {
+        count.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    return channel;
+}
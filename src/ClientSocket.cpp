@@ -53,24 +53,42 @@ void ClientSocket::connect() {
     }
 
     active = true;
-    channel = std::make_unique<Channel>(*this, getLogger(), listenCallback, socketDescriptor);
+    channel = std::make_unique<Channel>(*this, getLogger(), listenCallback, frameCallback, writabilityCallback,
+                                        socketDescriptor);
 
-    if (connectCallback.empty()) {
-        return;
-    }
-    std::thread([this] {
-        connectCallback.invoke(*channel, true);
-    }).detach();
+    eventLoop = socketHandler->createEventLoop(bufferSize);
+    eventLoop->add(*channel);
+    workerThread = std::thread(&ClientSocket::workerLoop, this);
+
+    dispatchCallback(*channel, [this] {
+        if (!connectCallback.empty()) {
+            connectCallback.invoke(*channel, true);
+        }
+    });
 }
 
 ClientSocket::~ClientSocket() {
     clientLog(LoggerLevel::DEBUG_LEVEL, "Deleting client socket");
 
     close();
+
+    // They use the channel
+    awaitCallbacks();
     clientLog(LoggerLevel::DEBUG_LEVEL, "Finish deleting client socket");
 }
 
 void ClientSocket::close() {
+    notifyStop();
+    if (eventLoop) {
+        eventLoop->wakeup();
+    }
+    if (workerThread.joinable() && workerThread.get_id() != std::this_thread::get_id()) {
+        workerThread.join();
+    }
+    if (eventLoop && channel) {
+        eventLoop->remove(*channel);
+    }
+
     if (socketDescriptor != -1) {
         int status = shutdown(socketDescriptor, SHUT_RDWR);
 
@@ -86,11 +104,12 @@ void ClientSocket::close() {
         socketDescriptor = -1;
     }
 
-    Channel &channelRef = *channel;
-    if (!connectCallback.empty()) {
-        // TODO: Catch exceptions?
-        // TODO: Should we even use reference types here?
-        connectCallback.invoke(channelRef, false);
+    if (channel) {
+        dispatchCallback(*channel, [this] {
+            if (!connectCallback.empty()) {
+                connectCallback.invoke(*channel, false);
+            }
+        });
     }
 
     clientLog(LoggerLevel::DEBUG_LEVEL, "Closed client socket");
@@ -98,33 +117,24 @@ void ClientSocket::close() {
     // TODO: Somehow validate that there are no memory leaks here?
 }
 
-void ClientSocket::readLoop() {
+void ClientSocket::workerLoop() {
     byte buf[bufferSize];
     std::span byteSpan(buf, bufferSize);
 
-    auto logToken = this->getLogger().createProducerToken();
-    while (isActive()) {
-        auto sleepTime = std::chrono::microseconds(500);
-
-        bool foundReadableChannel = channel->readData(byteSpan, logToken);
-
-        if (!foundReadableChannel) {
-            std::this_thread::yield();
-            std::this_thread::sleep_for(sleepTime);
-        }
-    }
-}
+    constexpr std::size_t maxEvents = 8;
+    IoEvent events[maxEvents];
 
-void ClientSocket::writeLoop() {
     auto logToken = this->getLogger().createProducerToken();
     while (isActive()) {
-        auto sleepTime = std::chrono::microseconds(500);
+        // Timeout only exists to notice notifyStop
+        auto eventCount = eventLoop->wait(events, std::chrono::milliseconds(100));
 
-        bool foundReadableChannel = channel->handleWriteQueue(logToken);
-
-        if (!foundReadableChannel) {
-            std::this_thread::yield();
-            std::this_thread::sleep_for(sleepTime);
+        for (auto const &event: std::span(events, eventCount)) {
+            channel->handleEvent(event, byteSpan, logToken);
         }
+
+        eventLoop->drainWritable([&](int) {
+            channel->handleScheduledWrite(logToken);
+        });
     }
 }
@@ -0,0 +1,93 @@
+#include "EpochReclaimer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+using namespace SocketLib;
+
+EpochReclaimer::Guard::Guard(EpochReclaimer &reclaimer) : slot(reclaimer.acquireSlot()) {}
+
+EpochReclaimer::Guard::~Guard() {
+    slot.store(0, std::memory_order_release);
+}
+
+EpochReclaimer::~EpochReclaimer() {
+    for (auto &object: retired) {
+        object.deleter();
+    }
+}
+
+std::atomic_uint64_t &EpochReclaimer::acquireSlot() {
+    // Start where this thread usually lands so pins on different threads rarely touch the same slot
+    auto const start = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+    while (true) {
+        for (std::size_t i = 0; i < SLOT_COUNT; i++) {
+            auto &slot = slots[(start + i) % SLOT_COUNT].epoch;
+            uint64_t expected = 0;
+
+            // Announcing the epoch is ordered before every pointer read under the pin.
+            // If retire advanced the epoch in between, the collector either saw this slot or the object
+            // was unlinked before any of those reads
+            if (slot.load(std::memory_order_relaxed) == 0 &&
+                slot.compare_exchange_strong(expected, epoch.load(std::memory_order_seq_cst),
+                                             std::memory_order_seq_cst)) {
+                return slot;
+            }
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+void EpochReclaimer::retire(std::function<void()> deleter) {
+    // Pins taken after this can't reach the object, the caller already unlinked it
+    auto const retiredEpoch = epoch.fetch_add(1, std::memory_order_seq_cst);
+
+    {
+        std::unique_lock lock(retiredMutex);
+        retired.push_back({retiredEpoch, std::move(deleter)});
+    }
+
+    collect();
+}
+
+std::size_t EpochReclaimer::collect() {
+    auto oldestPin = std::numeric_limits<uint64_t>::max();
+    for (auto &slot: slots) {
+        auto const pinned = slot.epoch.load(std::memory_order_seq_cst);
+        if (pinned != 0) {
+            oldestPin = std::min(oldestPin, pinned);
+        }
+    }
+
+    std::vector<Retired> reclaimable;
+    {
+        std::unique_lock lock(retiredMutex);
+        auto it = std::partition(retired.begin(), retired.end(), [oldestPin](Retired const &object) {
+            return object.epoch >= oldestPin;
+        });
+
+        reclaimable.insert(reclaimable.end(), std::make_move_iterator(it), std::make_move_iterator(retired.end()));
+        retired.erase(it, retired.end());
+    }
+
+    // Outside the lock, deleters may retire more
+    for (auto &object: reclaimable) {
+        object.deleter();
+    }
+
+    return reclaimable.size();
+}
+
+EpochReclaimer &EpochReclaimer::getCommon() {
+    static EpochReclaimer reclaimer;
+
+    return reclaimer;
+}
+
+std::size_t EpochReclaimer::pendingCount() {
+    std::unique_lock lock(retiredMutex);
+    return retired.size();
+}
@@ -0,0 +1,113 @@
+#include "EpollEventLoop.hpp"
+
+#include "Socket.hpp"
+#include "SocketUtil.hpp"
+#include "SocketLogger.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace SocketLib;
+
+EpollEventLoop::EpollEventLoop(Logger &logger) : EventLoop(logger) {
+    epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (epollDescriptor < 0) {
+        logger.fmtThrowError(EVENT_LOOP_LOG_TAG, "Unable to create epoll instance: {}", strerror(errno));
+    }
+
+    wakeDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeDescriptor < 0) {
+        close(epollDescriptor);
+        logger.fmtThrowError(EVENT_LOOP_LOG_TAG, "Unable to create wakeup descriptor: {}", strerror(errno));
+    }
+
+    // Level triggered, the counter is drained on every wait
+    epoll_event wakeEvent{};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.fd = wakeDescriptor;
+    Utils::throwIfError(logger, epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, wakeDescriptor, &wakeEvent),
+                        EVENT_LOOP_LOG_TAG);
+}
+
+EpollEventLoop::~EpollEventLoop() {
+    if (wakeDescriptor != -1) {
+        close(wakeDescriptor);
+        wakeDescriptor = -1;
+    }
+    if (epollDescriptor != -1) {
+        close(epollDescriptor);
+        epollDescriptor = -1;
+    }
+}
+
+void EpollEventLoop::add(Channel &channel) {
+    setChannelLoop(channel, this);
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = channel.clientDescriptor;
+    Utils::throwIfError(logger, epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, channel.clientDescriptor, &event),
+                        EVENT_LOOP_LOG_TAG);
+
+    // Anything queued before registration would otherwise wait for the next EPOLLOUT edge
+    queueWritable(channel);
+}
+
+void EpollEventLoop::remove(Channel &channel) {
+    // Descriptor may already be closed, in which case the kernel has dropped it for us
+    Utils::logIfError<false, LoggerLevel::DEBUG_LEVEL>(
+            logger, epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, channel.clientDescriptor, nullptr),
+            EVENT_LOOP_LOG_TAG, "removing channel");
+    setChannelLoop(channel, nullptr);
+}
+
+void EpollEventLoop::addListener(int listenDescriptor) {
+    // Level triggered, the listener may stop accepting early under load and we don't want to lose the backlog
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listenDescriptor;
+    Utils::throwIfError(logger, epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, listenDescriptor, &event),
+                        EVENT_LOOP_LOG_TAG);
+}
+
+void EpollEventLoop::wakeup() {
+    uint64_t one = 1;
+    // Only fails if the counter would overflow, in which case the loop is already awake
+    [[maybe_unused]] auto written = ::write(wakeDescriptor, &one, sizeof(one));
+}
+
+std::size_t EpollEventLoop::wait(std::span<IoEvent> events, std::chrono::milliseconds timeout) {
+    constexpr std::size_t maxEvents = 64;
+    epoll_event epollEvents[maxEvents];
+
+    int count = epoll_wait(epollDescriptor, epollEvents, static_cast<int>(std::min(events.size(), maxEvents)),
+                           static_cast<int>(timeout.count()));
+
+    if (count < 0) {
+        if (errno != EINTR) {
+            Utils::logIfError(logger, count, EVENT_LOOP_LOG_TAG, "epoll_wait");
+        }
+        return 0;
+    }
+
+    std::size_t written = 0;
+    for (int i = 0; i < count; i++) {
+        auto const &epollEvent = epollEvents[i];
+
+        if (epollEvent.data.fd == wakeDescriptor) {
+            uint64_t counter;
+            [[maybe_unused]] auto read = ::read(wakeDescriptor, &counter, sizeof(counter));
+            continue;
+        }
+
+        events[written++] = IoEvent{
+                .fd = epollEvent.data.fd,
+                .readable = (epollEvent.events & EPOLLIN) != 0,
+                .writable = (epollEvent.events & EPOLLOUT) != 0,
+                .hangup = (epollEvent.events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0
+        };
+    }
+
+    return written;
+}
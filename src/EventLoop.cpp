@@ -0,0 +1,47 @@
+#include "EventLoop.hpp"
+
+#include "Socket.hpp"
+
+using namespace SocketLib;
+
+void EventLoop::queueWritable(Channel &channel) {
+    if (channel.writeScheduled.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+
+    pendingWrites.enqueue(channel.clientDescriptor);
+    wakeup();
+}
+
+void EventLoop::queueWritable(std::span<Channel *const> channels) {
+    constexpr std::size_t batchSize = 64;
+    int descriptors[batchSize];
+    std::size_t count = 0;
+    bool queued = false;
+
+    for (auto *channel: channels) {
+        if (channel->writeScheduled.exchange(true, std::memory_order_acq_rel)) {
+            continue;
+        }
+
+        descriptors[count++] = channel->clientDescriptor;
+        if (count == batchSize) {
+            pendingWrites.enqueue_bulk(descriptors, count);
+            count = 0;
+            queued = true;
+        }
+    }
+
+    if (count > 0) {
+        pendingWrites.enqueue_bulk(descriptors, count);
+        queued = true;
+    }
+
+    if (queued) {
+        wakeup();
+    }
+}
+
+void EventLoop::setChannelLoop(Channel &channel, EventLoop *loop) {
+    channel.eventLoop.store(loop, std::memory_order_release);
+}
@@ -0,0 +1,101 @@
+#include "Framing.hpp"
+
+using namespace SocketLib;
+
+namespace {
+    template<std::size_t N, bool bigEndian>
+    uint64_t readFixed(std::span<const uint8_t> bytes) {
+        uint64_t value = 0;
+        for (std::size_t i = 0; i < N; i++) {
+            auto const shift = bigEndian ? (N - 1 - i) * 8 : i * 8;
+            value |= static_cast<uint64_t>(bytes[i]) << shift;
+        }
+        return value;
+    }
+
+    std::size_t fixedSize(FrameFormat format) {
+        switch (format) {
+            case FrameFormat::U8:
+                return 1;
+            case FrameFormat::U16BE:
+            case FrameFormat::U16LE:
+                return 2;
+            case FrameFormat::U32BE:
+            case FrameFormat::U32LE:
+                return 4;
+            default:
+                return 0;
+        }
+    }
+}
+
+FrameDecoder::Header FrameDecoder::parseHeader(std::span<const uint8_t> bytes) const {
+    Header header{HeaderStatus::Incomplete};
+
+    if (options.format == FrameFormat::Varint) {
+        for (std::size_t i = 0; i < bytes.size() && i < MAX_HEADER_SIZE; i++) {
+            auto const bits = static_cast<uint64_t>(bytes[i] & 0x7F);
+            // The tenth byte only has room for the top bit
+            if (i == MAX_HEADER_SIZE - 1 && bits > 1) {
+                header.status = HeaderStatus::Invalid;
+                return header;
+            }
+
+            header.payloadSize |= bits << (7 * i);
+            if ((bytes[i] & 0x80) == 0) {
+                header.status = HeaderStatus::Complete;
+                header.headerSize = i + 1;
+                break;
+            }
+        }
+
+        if (header.status == HeaderStatus::Incomplete && bytes.size() >= MAX_HEADER_SIZE) {
+            header.status = HeaderStatus::Invalid;
+        }
+    } else {
+        auto const size = fixedSize(options.format);
+        if (bytes.size() < size) {
+            return header;
+        }
+
+        switch (options.format) {
+            case FrameFormat::U8:
+                header.payloadSize = bytes[0];
+                break;
+            case FrameFormat::U16BE:
+                header.payloadSize = readFixed<2, true>(bytes);
+                break;
+            case FrameFormat::U16LE:
+                header.payloadSize = readFixed<2, false>(bytes);
+                break;
+            case FrameFormat::U32BE:
+                header.payloadSize = readFixed<4, true>(bytes);
+                break;
+            case FrameFormat::U32LE:
+                header.payloadSize = readFixed<4, false>(bytes);
+                break;
+            default:
+                header.status = HeaderStatus::Invalid;
+                return header;
+        }
+
+        header.status = HeaderStatus::Complete;
+        header.headerSize = size;
+    }
+
+    if (header.status == HeaderStatus::Complete && header.payloadSize > options.maxFrameSize) {
+        header.status = HeaderStatus::Invalid;
+    }
+
+    return header;
+}
+
+std::span<const uint8_t> FrameDecoder::headerBytes(StreamQueue const &pending, std::span<const uint8_t> bytes) {
+    auto size = pending.copyTo(headerScratch);
+
+    auto const fromBytes = std::min(bytes.size(), headerScratch.size() - size);
+    std::copy_n(bytes.begin(), fromBytes, headerScratch.begin() + size);
+    size += fromBytes;
+
+    return {headerScratch.data(), size};
+}
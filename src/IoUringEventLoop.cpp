@@ -0,0 +1,622 @@
+#include "IoUringEventLoop.hpp"
+
+#ifdef SOCKETLIB_IO_URING
+
+#include "Socket.hpp"
+#include "SocketUtil.hpp"
+#include "SocketLogger.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+using namespace SocketLib;
+
+namespace {
+    int ioUringSetup(unsigned entries, io_uring_params* params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int ioUringRegister(int fd, unsigned opcode, void* arg, unsigned argCount) {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, argCount));
+    }
+
+    int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, std::size_t argSize) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+    }
+
+    template<typename T>
+    T* ringOffset(void* ring, uint32_t offset) {
+        return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+    }
+
+    template<typename T>
+    T loadAcquire(T* p) {
+        return std::atomic_ref<T>(*p).load(std::memory_order_acquire);
+    }
+
+    template<typename T>
+    void storeRelease(T* p, T value) {
+        std::atomic_ref<T>(*p).store(value, std::memory_order_release);
+    }
+
+    constexpr uint16_t bufferGroup = 0;
+}
+
+IoUringEventLoop::IoUringEventLoop(Logger &logger, uint32_t bufferSize, uint32_t entries, uint16_t providedBuffers)
+        : EventLoop(logger), bufferSize(bufferSize) {
+    io_uring_params params{};
+    // Each channel keeps a recv and possibly a send in flight, leave plenty of room for completions.
+    // The kernel clamps both sizes to its limits instead of failing for large entries
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(entries) * 16, UINT32_MAX));
+
+    ringDescriptor = ioUringSetup(entries, &params);
+    if (ringDescriptor < 0) {
+        logger.fmtThrowError(EVENT_LOOP_LOG_TAG, "Unable to set up io_uring: {}", strerror(errno));
+    }
+
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        close(ringDescriptor);
+        logger.fmtThrowError(EVENT_LOOP_LOG_TAG, "io_uring is missing required features, kernel too old");
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    bool const singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor,
+                  IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        sqRing = nullptr;
+        unmapRing();
+        logger.fmtThrowError(EVENT_LOOP_LOG_TAG, "Unable to map io_uring submission ring: {}", strerror(errno));
+    }
+
+    if (singleMmap) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor,
+                      IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            cqRing = nullptr;
+            unmapRing();
+            logger.fmtThrowError(EVENT_LOOP_LOG_TAG, "Unable to map io_uring completion ring: {}", strerror(errno));
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                           ringDescriptor, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) {
+        sqes = nullptr;
+        unmapRing();
+        logger.fmtThrowError(EVENT_LOOP_LOG_TAG, "Unable to map io_uring submission entries: {}", strerror(errno));
+    }
+
+    sqHead = ringOffset<unsigned>(sqRing, params.sq_off.head);
+    sqTail = ringOffset<unsigned>(sqRing, params.sq_off.tail);
+    sqMask = *ringOffset<unsigned>(sqRing, params.sq_off.ring_mask);
+    sqEntries = *ringOffset<unsigned>(sqRing, params.sq_off.ring_entries);
+    sqArray = ringOffset<unsigned>(sqRing, params.sq_off.array);
+
+    cqHead = ringOffset<unsigned>(cqRing, params.cq_off.head);
+    cqTail = ringOffset<unsigned>(cqRing, params.cq_off.tail);
+    cqMask = *ringOffset<unsigned>(cqRing, params.cq_off.ring_mask);
+    cqes = ringOffset<io_uring_cqe>(cqRing, params.cq_off.cqes);
+
+    wakeDescriptor = eventfd(0, EFD_CLOEXEC);
+    if (wakeDescriptor < 0) {
+        unmapRing();
+        logger.fmtThrowError(EVENT_LOOP_LOG_TAG, "Unable to create wakeup descriptor: {}", strerror(errno));
+    }
+
+    setupBufferRing(providedBuffers);
+}
+
+IoUringEventLoop::~IoUringEventLoop() {
+    unmapRing();
+
+    // Ring is closed, the kernel no longer references the buffers
+    if (bufferRing != nullptr) {
+        munmap(bufferRing, bufferRingSize);
+        bufferRing = nullptr;
+    }
+
+    if (wakeDescriptor != -1) {
+        close(wakeDescriptor);
+        wakeDescriptor = -1;
+    }
+}
+
+void IoUringEventLoop::unmapRing() {
+    if (sqes != nullptr) {
+        munmap(sqes, sqesSize);
+        sqes = nullptr;
+    }
+    if (cqRing != nullptr && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    cqRing = nullptr;
+    if (sqRing != nullptr) {
+        munmap(sqRing, sqRingSize);
+        sqRing = nullptr;
+    }
+
+    // Closing the ring cancels everything still in flight
+    if (ringDescriptor != -1) {
+        close(ringDescriptor);
+        ringDescriptor = -1;
+    }
+}
+
+void IoUringEventLoop::setupBufferRing(uint16_t count) {
+    if (count == 0 || (count & (count - 1)) != 0) {
+        logger.fmtLog<LoggerLevel::WARN>(EVENT_LOOP_LOG_TAG,
+                                         "Provided buffer count {} is not a power of two, using a buffer per channel",
+                                         count);
+        return;
+    }
+
+    // Page aligned and zeroed, as the kernel expects
+    bufferRingSize = count * sizeof(io_uring_buf);
+    void *ring = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring == MAP_FAILED) {
+        return;
+    }
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = count;
+    reg.bgid = bufferGroup;
+
+    if (ioUringRegister(ringDescriptor, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        logger.fmtLog<LoggerLevel::DEBUG_LEVEL>(EVENT_LOOP_LOG_TAG,
+                                                "Provided buffer rings unsupported ({}), using a buffer per channel",
+                                                strerror(errno));
+        munmap(ring, bufferRingSize);
+        return;
+    }
+
+    bufferRing = static_cast<io_uring_buf_ring *>(ring);
+    providedBufferCount = count;
+    providedBufferStorage = std::make_unique<byte[]>(static_cast<std::size_t>(count) * bufferSize);
+
+    for (uint16_t bid = 0; bid < count; bid++) {
+        consumedBuffers.push_back(bid);
+    }
+    recycleBuffers();
+
+    multishotRecv = true;
+}
+
+void IoUringEventLoop::recycleBuffers() {
+    if (consumedBuffers.empty()) {
+        return;
+    }
+
+    // Not bufferRing->bufs, __DECLARE_FLEX_ARRAY's empty struct shifts it by 8 bytes in C++
+    auto *bufs = reinterpret_cast<io_uring_buf *>(bufferRing);
+
+    uint16_t const mask = providedBufferCount - 1;
+    for (uint16_t bid: consumedBuffers) {
+        auto &buf = bufs[bufferRingTail & mask];
+        buf.addr = reinterpret_cast<uint64_t>(providedBufferStorage.get() + static_cast<std::size_t>(bid) * bufferSize);
+        buf.len = bufferSize;
+        buf.bid = bid;
+        bufferRingTail++;
+    }
+    consumedBuffers.clear();
+
+    storeRelease(&bufferRing->tail, bufferRingTail);
+}
+
+void IoUringEventLoop::add(Channel &channel) {
+    setChannelLoop(channel, this);
+
+    {
+        std::lock_guard lock(commandsMutex);
+        commands.push_back({channel.clientDescriptor, false, true});
+    }
+
+    // Also wakes the loop so the registration is applied
+    queueWritable(channel);
+}
+
+void IoUringEventLoop::remove(Channel &channel) {
+    setChannelLoop(channel, nullptr);
+
+    {
+        std::lock_guard lock(commandsMutex);
+        commands.push_back({channel.clientDescriptor, false, false});
+    }
+    wakeup();
+}
+
+void IoUringEventLoop::addListener(int listenDescriptor) {
+    {
+        std::lock_guard lock(commandsMutex);
+        commands.push_back({listenDescriptor, true, true});
+    }
+    wakeup();
+}
+
+void IoUringEventLoop::wakeup() {
+    uint64_t one = 1;
+    // Only fails if the counter would overflow, in which case the loop is already awake
+    [[maybe_unused]] auto written = ::write(wakeDescriptor, &one, sizeof(one));
+}
+
+io_uring_sqe *IoUringEventLoop::getSqe() {
+    unsigned tail = *sqTail;
+    if (tail - loadAcquire(sqHead) >= sqEntries) {
+        // Full, hand what we have to the kernel without waiting for completions
+        submit(0, std::chrono::milliseconds(0));
+        tail = *sqTail;
+        if (tail - loadAcquire(sqHead) >= sqEntries) {
+            return nullptr;
+        }
+    }
+
+    unsigned index = tail & sqMask;
+    io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+
+    sqArray[index] = index;
+    storeRelease(sqTail, tail + 1);
+
+    return sqe;
+}
+
+void IoUringEventLoop::submit(unsigned minComplete, std::chrono::milliseconds timeout) {
+    unsigned flags = 0;
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+
+    if (minComplete > 0) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        ts.tv_sec = timeout.count() / 1000;
+        ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+
+    // Kernel advances the head past whatever it consumed, even if the wait itself fails
+    unsigned const toSubmit = *sqTail - loadAcquire(sqHead);
+    int submitted = ioUringEnter(ringDescriptor, toSubmit, minComplete, flags,
+                                 minComplete > 0 ? &arg : nullptr, minComplete > 0 ? sizeof(arg) : 0);
+    if (submitted < 0) {
+        auto err = errno;
+        // Timed out, interrupted or completions need reaping first
+        if (err != ETIME && err != EINTR && err != EBUSY && err != EAGAIN) {
+            logger.fmtLog<LoggerLevel::ERROR>(EVENT_LOOP_LOG_TAG, "io_uring_enter failed: {}", strerror(err));
+        }
+    }
+}
+
+void IoUringEventLoop::applyCommands() {
+    {
+        std::lock_guard lock(commandsMutex);
+        commands.swap(commandsBack);
+    }
+
+    for (auto const &command: commandsBack) {
+        // A removal, or the descriptor was reused before we saw the removal of its previous owner
+        if (auto it = registrations.find(command.fd); it != registrations.end()) {
+            retire(std::move(it->second));
+            registrations.erase(it);
+        }
+
+        if (!command.add) {
+            continue;
+        }
+
+        auto registration = std::make_unique<Registration>();
+        registration->fd = command.fd;
+        registration->listener = command.listener;
+
+        auto &ref = *registrations.emplace(command.fd, std::move(registration)).first->second;
+        if (ref.listener) {
+            armAccept(ref);
+        } else {
+            armRecv(ref);
+        }
+    }
+
+    commandsBack.clear();
+}
+
+void IoUringEventLoop::retire(std::unique_ptr<Registration> registration) {
+    registration->removed = true;
+    std::erase(pendingArms, registration.get());
+
+    if (registration->inFlight == 0) {
+        return;
+    }
+
+    // Keep the buffers alive until the kernel is done with them
+    cancel(*registration);
+    auto *registrationPtr = registration.get();
+    retired.emplace(registrationPtr, std::move(registration));
+}
+
+void IoUringEventLoop::armRecv(Registration &registration) {
+    auto *sqe = getSqe();
+    if (sqe == nullptr) {
+        pendingArms.push_back(&registration);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = registration.fd;
+
+    if (multishotRecv) {
+        // Kernel picks a buffer once data arrives and keeps the recv armed until it runs out
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = bufferGroup;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+    } else {
+        if (!registration.buffer) {
+            registration.buffer = std::make_unique<byte[]>(bufferSize);
+        }
+        sqe->addr = reinterpret_cast<uint64_t>(registration.buffer.get());
+        sqe->len = bufferSize;
+    }
+
+    sqe->user_data = reinterpret_cast<uint64_t>(&registration) | static_cast<uint64_t>(Operation::Recv);
+    registration.inFlight++;
+}
+
+void IoUringEventLoop::armAccept(Registration &registration) {
+    auto *sqe = getSqe();
+    if (sqe == nullptr) {
+        pendingArms.push_back(&registration);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = registration.fd;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    if (multishotAccept) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    }
+    sqe->user_data = reinterpret_cast<uint64_t>(&registration) | static_cast<uint64_t>(Operation::Accept);
+    registration.inFlight++;
+}
+
+void IoUringEventLoop::armWake() {
+    auto *sqe = getSqe();
+    if (sqe == nullptr) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeDescriptor;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeCounter);
+    sqe->len = sizeof(wakeCounter);
+    sqe->user_data = static_cast<uint64_t>(Operation::Wake);
+    wakeArmed = true;
+}
+
+void IoUringEventLoop::cancel(Registration &registration) {
+    auto *sqe = getSqe();
+    if (sqe == nullptr) {
+        // Otherwise the recv or accept stays armed and the registration is never released
+        pendingCancels.push_back(&registration);
+        return;
+    }
+
+    // Only the recv/accept would stay pending forever, sends complete on their own
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(&registration) |
+                static_cast<uint64_t>(registration.listener ? Operation::Accept : Operation::Recv);
+    sqe->user_data = static_cast<uint64_t>(Operation::Cancel);
+}
+
+void IoUringEventLoop::release(Registration &registration) {
+    registration.inFlight--;
+    if (registration.removed && registration.inFlight == 0) {
+        std::erase(pendingCancels, &registration);
+        retired.erase(&registration);
+    }
+}
+
+bool IoUringEventLoop::submitSend(Channel &channel, std::shared_ptr<SendBatch> const &batch) {
+    // Registration is applied on the next wait, as is a full submission queue flushed
+    auto it = registrations.find(channel.clientDescriptor);
+    if (it == registrations.end()) {
+        deferredWrites.push_back(channel.clientDescriptor);
+        return false;
+    }
+
+    auto *sqe = getSqe();
+    if (sqe == nullptr) {
+        deferredWrites.push_back(channel.clientDescriptor);
+        return false;
+    }
+
+    auto &registration = *it->second;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = registration.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&batch->header);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<uint64_t>(&registration) | static_cast<uint64_t>(Operation::Send);
+    registration.inFlight++;
+    registration.sendBatch = batch;
+
+    return true;
+}
+
+std::size_t IoUringEventLoop::wait(std::span<IoEvent> events, std::chrono::milliseconds timeout) {
+    // Buffers handed out by the previous wait are free again
+    recycleBuffers();
+
+    applyCommands();
+
+    auto rearm = std::move(pendingArms);
+    pendingArms.clear();
+    for (auto *registration: rearm) {
+        if (registration->removed) {
+            continue;
+        }
+        if (registration->listener) {
+            armAccept(*registration);
+        } else {
+            armRecv(*registration);
+        }
+    }
+
+    auto cancels = std::move(pendingCancels);
+    pendingCancels.clear();
+    for (auto *registration: cancels) {
+        cancel(*registration);
+    }
+
+    if (!wakeArmed) {
+        armWake();
+    }
+
+    // Writes that couldn't be submitted last time are retried right after this wait
+    for (int fd: deferredWrites) {
+        requeueWritable(fd);
+    }
+    // Recvs, accepts and cancels still waiting for room are retried by the next wait, without sleeping in between
+    bool const retry = !deferredWrites.empty() || !pendingArms.empty() || !pendingCancels.empty();
+    deferredWrites.clear();
+
+    // Submits everything queued since the last wait with the same syscall
+    if (loadAcquire(cqTail) == *cqHead && !retry) {
+        submit(1, timeout);
+    } else if (*sqTail != loadAcquire(sqHead)) {
+        submit(0, std::chrono::milliseconds(0));
+    }
+
+    std::size_t written = 0;
+    unsigned head = *cqHead;
+    unsigned const tail = loadAcquire(cqTail);
+
+    for (; head != tail && written < events.size(); head++) {
+        auto const &cqe = cqes[head & cqMask];
+        auto const operation = static_cast<Operation>(cqe.user_data & 7);
+        auto *registration = reinterpret_cast<Registration *>(cqe.user_data & ~static_cast<uint64_t>(7));
+
+        if (operation == Operation::Wake) {
+            wakeArmed = false;
+            continue;
+        }
+        if (operation == Operation::Cancel || registration == nullptr) {
+            continue;
+        }
+
+        int const fd = registration->fd;
+        bool const removed = registration->removed;
+        bool const more = cqe.flags & IORING_CQE_F_MORE;
+
+        std::span<byte> received;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            auto const bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            consumedBuffers.push_back(bid);
+            if (cqe.res > 0) {
+                received = {providedBufferStorage.get() + static_cast<std::size_t>(bid) * bufferSize,
+                            static_cast<std::size_t>(cqe.res)};
+            }
+        } else if (cqe.res > 0 && registration->buffer) {
+            received = {registration->buffer.get(), static_cast<std::size_t>(cqe.res)};
+        }
+
+        if (operation == Operation::Send) {
+            registration->sendBatch.reset();
+        }
+
+        // Multishot operations stay in flight until the kernel stops setting F_MORE
+        if (!more) {
+            release(*registration);
+        }
+        if (removed) {
+            continue;
+        }
+
+        switch (operation) {
+            case Operation::Recv:
+                // Kernel without multishot recv, fall back to a buffer per channel
+                if (cqe.res == -EINVAL && multishotRecv) {
+                    logger.writeLog<LoggerLevel::DEBUG_LEVEL>(EVENT_LOOP_LOG_TAG,
+                                                              "Multishot recv unsupported, using a buffer per channel");
+                    multishotRecv = false;
+                    pendingArms.push_back(registration);
+                    break;
+                }
+
+                // Interrupted, or the buffer ring ran dry and will be refilled next wait
+                if (cqe.res == -EAGAIN || cqe.res == -EINTR || cqe.res == -ENOBUFS) {
+                    if (!more) {
+                        pendingArms.push_back(registration);
+                    }
+                    break;
+                }
+
+                events[written++] = IoEvent{
+                        .fd = fd,
+                        .completion = IoEvent::Completion::Received,
+                        .result = cqe.res,
+                        .data = received
+                };
+
+                // EOF and errors end the channel, anything else keeps receiving
+                if (cqe.res > 0 && !more) {
+                    pendingArms.push_back(registration);
+                }
+                break;
+            case Operation::Send:
+                events[written++] = IoEvent{
+                        .fd = fd,
+                        .completion = IoEvent::Completion::Sent,
+                        .result = cqe.res
+                };
+                break;
+            case Operation::Accept:
+                if (cqe.res >= 0) {
+                    events[written++] = IoEvent{
+                            .fd = fd,
+                            .completion = IoEvent::Completion::Accepted,
+                            .result = cqe.res
+                    };
+                } else if (cqe.res == -EINVAL && multishotAccept) {
+                    logger.writeLog<LoggerLevel::DEBUG_LEVEL>(EVENT_LOOP_LOG_TAG,
+                                                              "Multishot accept unsupported, accepting one at a time");
+                    multishotAccept = false;
+                    armAccept(*registration);
+                    break;
+                } else if (cqe.res != -EAGAIN && cqe.res != -EINTR && cqe.res != -ECONNABORTED) {
+                    logger.fmtLog<LoggerLevel::ERROR>(EVENT_LOOP_LOG_TAG, "Failed to accept client: {}",
+                                                      strerror(-cqe.res));
+                }
+
+                // Listener closed, stop accepting
+                if (!more && cqe.res != -EBADF && cqe.res != -EINVAL) {
+                    armAccept(*registration);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    storeRelease(cqHead, head);
+
+    return written;
+}
+
+#endif
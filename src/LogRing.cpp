@@ -0,0 +1,110 @@
+#include "LogRing.hpp"
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+using namespace SocketLib;
+
+namespace {
+    // Open addressing, kept at most half full so probes stay short and always end
+    constexpr std::size_t TAG_SLOTS = detail::MAX_LOG_TAGS * 2;
+
+    struct TagRegistry {
+        // Only taken to add a tag
+        std::mutex mutex;
+        // Deque so names handed out stay put while more are added
+        std::deque<std::string> storage;
+
+        // Written before count publishes them, never changed after
+        std::array<std::string_view, detail::MAX_LOG_TAGS> names;
+        std::atomic_uint32_t count = 0;
+        // Id + 1 of the tag hashed there, 0 if empty. Published after its name
+        std::array<std::atomic_uint16_t, TAG_SLOTS> slots{};
+
+        /// The tag's id, or the empty slot it would go in as TAG_SLOTS + slot
+        std::size_t find(std::string_view tag, std::size_t hash) const {
+            for (std::size_t i = hash % TAG_SLOTS;; i = (i + 1) % TAG_SLOTS) {
+                auto const slot = slots[i].load(std::memory_order_acquire);
+                if (slot == 0) {
+                    return TAG_SLOTS + i;
+                }
+                if (names[slot - 1] == tag) {
+                    return slot - 1;
+                }
+            }
+        }
+    };
+
+    TagRegistry& tagRegistry() {
+        static TagRegistry registry;
+        return registry;
+    }
+}
+
+uint16_t detail::internLogTag(std::string_view tag) {
+    auto& registry = tagRegistry();
+    auto const hash = std::hash<std::string_view>()(tag);
+
+    auto found = registry.find(tag, hash);
+    if (found < TAG_SLOTS) {
+        return static_cast<uint16_t>(found);
+    }
+
+    std::unique_lock lock(registry.mutex);
+    // Only added under the lock, so the slot found now stays empty until we fill it
+    found = registry.find(tag, hash);
+    if (found < TAG_SLOTS) {
+        return static_cast<uint16_t>(found);
+    }
+
+    auto const id = registry.count.load(std::memory_order_relaxed);
+    if (id == MAX_LOG_TAGS) {
+        return static_cast<uint16_t>(MAX_LOG_TAGS);
+    }
+
+    registry.names[id] = registry.storage.emplace_back(tag);
+    registry.count.store(id + 1, std::memory_order_release);
+    registry.slots[found - TAG_SLOTS].store(static_cast<uint16_t>(id + 1), std::memory_order_release);
+
+    return static_cast<uint16_t>(id);
+}
+
+std::string_view detail::logTagName(uint16_t id) {
+    auto& registry = tagRegistry();
+    return id < registry.count.load(std::memory_order_acquire) ? registry.names[id] : std::string_view("unknown");
+}
+
+std::byte* LogRing::reserve(std::size_t size) {
+    size = alignUp(size);
+    if (size > CAPACITY / 4) {
+        return nullptr;
+    }
+
+    auto const position = tail.load(std::memory_order_relaxed);
+    auto const offset = position % CAPACITY;
+    // A record never wraps, the rest of the buffer is skipped instead
+    auto const padding = offset + size > CAPACITY ? CAPACITY - offset : 0;
+    auto const needed = padding + size;
+
+    if (position + needed - cachedHead > CAPACITY) {
+        cachedHead = head.load(std::memory_order_acquire);
+        if (position + needed - cachedHead > CAPACITY) {
+            return nullptr;
+        }
+    }
+
+    if (padding != 0) {
+        uint32_t const marker = 0;
+        std::memcpy(buffer.get() + offset, &marker, sizeof(marker));
+    }
+
+    pending = needed;
+    return buffer.get() + (padding != 0 ? 0 : offset);
+}
+
+void LogRing::commit() {
+    tail.store(tail.load(std::memory_order_relaxed) + pending, std::memory_order_release);
+    pending = 0;
+}
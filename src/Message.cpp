@@ -1 +1,76 @@
 #include "Message.hpp"
+
+#include <new>
+
+using namespace SocketLib;
+
+SharedMessageBuffer *SharedMessageBuffer::allocate(size_t len, BufferAllocator &allocator) {
+    // Header and bytes in one allocation
+    auto const size = sizeof(SharedMessageBuffer) + len;
+    auto *memory = allocator.allocate(size);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    return new(memory) SharedMessageBuffer{1, &allocator, size};
+}
+
+void SharedMessageBuffer::release() {
+    // Last reference, acquire so every other copy is done reading
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        auto *owner = allocator;
+        auto const allocationSize = size;
+
+        this->~SharedMessageBuffer();
+        owner->deallocate(reinterpret_cast<byte *>(this), allocationSize);
+    }
+}
+
+void Message::allocateHeap(BufferAllocator &allocator) {
+    _data = allocator.allocate(_len);
+    if (_data == nullptr) {
+        _len = 0;
+        throw std::bad_alloc();
+    }
+
+    _allocator = &allocator;
+}
+
+Message Message::makeShared(std::span<const byte> data, BufferAllocator &allocator) {
+    Message message;
+    if (data.empty()) {
+        return message;
+    }
+
+    message._shared = SharedMessageBuffer::allocate(data.size(), allocator);
+    message._data = message._shared->bytes();
+    message._len = data.size();
+    memcpy(message._data, data.data(), data.size());
+
+    return message;
+}
+
+Message Message::toShared() const {
+    if (_shared != nullptr || _data == nullptr || isInline()) {
+        return *this;
+    }
+
+    return makeShared(toSpan(), *_allocator);
+}
+
+Message &Message::share() {
+    // Copying an inline message never allocates, a shared buffer would only add one
+    if (_shared != nullptr || _data == nullptr || isInline()) {
+        return *this;
+    }
+
+    auto *shared = SharedMessageBuffer::allocate(_len, *_allocator);
+    memcpy(shared->bytes(), _data, _len);
+
+    _allocator->deallocate(_data, _len);
+    _allocator = nullptr;
+    _shared = shared;
+    _data = shared->bytes();
+
+    return *this;
+}
@@ -0,0 +1,101 @@
+#include "MessageBuilder.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+using namespace SocketLib;
+
+void MessageBuilder::grow(std::size_t needed) {
+    auto newCapacity = std::max(capacity * 2, initialCapacity);
+    newCapacity = std::max(newCapacity, HEADROOM + needed);
+
+    auto *newBuffer = SharedMessageBuffer::allocate(newCapacity, *allocator);
+    if (buffer != nullptr) {
+        std::memcpy(newBuffer->bytes() + HEADROOM, payload(), size);
+        buffer->release();
+    }
+
+    buffer = newBuffer;
+    capacity = newCapacity;
+}
+
+Message MessageBuilder::take(std::size_t offset) {
+    Message message;
+    if (buffer == nullptr || HEADROOM - offset + size == 0) {
+        return message;
+    }
+
+    // The builder's reference becomes the message's
+    message._shared = buffer;
+    message._data = buffer->bytes() + offset;
+    message._len = HEADROOM - offset + size;
+
+    buffer = nullptr;
+    capacity = 0;
+    size = 0;
+
+    return message;
+}
+
+void MessageBuilder::release() {
+    if (buffer != nullptr) {
+        buffer->release();
+    }
+
+    buffer = nullptr;
+    capacity = 0;
+    size = 0;
+}
+
+Message MessageBuilder::build(FramingOptions const &framing) {
+    if (size > framing.maxFrameSize) {
+        throw std::length_error("Message is larger than the frame size limit");
+    }
+
+    switch (framing.format) {
+        case FrameFormat::None:
+            return build();
+        case FrameFormat::Delimited:
+            writeU8(framing.delimiter);
+            return build();
+        default:
+            break;
+    }
+
+    std::array<byte, HEADROOM> prefix{};
+    auto const prefixSize = encodePrefix(framing.format, prefix);
+
+    // An empty frame is still a prefix
+    reserve(0);
+    std::memcpy(payload() - prefixSize, prefix.data(), prefixSize);
+    return take(HEADROOM - prefixSize);
+}
+
+std::size_t MessageBuilder::encodePrefix(FrameFormat format, std::span<byte, HEADROOM> out) const {
+    auto const fixed = [this, &out]<std::unsigned_integral T, std::endian order>() {
+        if (size > std::numeric_limits<T>::max()) {
+            throw std::length_error("Message is too large for the frame's length prefix");
+        }
+
+        store<T, order>(out.data(), static_cast<T>(size));
+        return sizeof(T);
+    };
+
+    switch (format) {
+        case FrameFormat::U8:
+            return fixed.operator()<uint8_t, std::endian::big>();
+        case FrameFormat::U16BE:
+            return fixed.operator()<uint16_t, std::endian::big>();
+        case FrameFormat::U16LE:
+            return fixed.operator()<uint16_t, std::endian::little>();
+        case FrameFormat::U32BE:
+            return fixed.operator()<uint32_t, std::endian::big>();
+        case FrameFormat::U32LE:
+            return fixed.operator()<uint32_t, std::endian::little>();
+        case FrameFormat::Varint:
+            return encodeVarint(size, out.data());
+        default:
+            return 0;
+    }
+}
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <iostream>
 #include <netinet/tcp.h>
+#include <sched.h>
 #include <unistd.h>
 
 
@@ -8,7 +10,7 @@
 #include "SocketHandler.hpp"
 
 #ifndef SOCKET_SERVER_BACKLOG
-#define SOCKET_SERVER_BACKLOG 10     // how many pending connections queue will hold
+#define SOCKET_SERVER_BACKLOG SOMAXCONN     // how many pending connections queue will hold
 #endif
 
 #define serverLog(level, ...) getLogger().fmtLog<level>(SERVER_LOG_TAG, __VA_ARGS__)
@@ -23,61 +25,123 @@ void ServerSocket::bindAndListen() {
 
     active = true;
 
+    setupListener(socketDescriptor);
+
+    // Handles only have room for so many workers
+    auto const shardCount = std::min<std::size_t>(std::max(workerThreadCount, (uint16_t) 1),
+                                                  ChannelHandle::MAX_SHARDS);
+    for (std::size_t i = 0; i < shardCount; i++) {
+        auto &shard = *shards.emplace_back(std::make_unique<Shard>());
+        shard.index = i;
+        shard.eventLoop = socketHandler->createEventLoop(bufferSize);
+
+        if (!shardedAccept) {
+            continue;
+        }
+
+        // The first worker reuses our descriptor, the kernel load balances between every listener on the port
+        if (i == 0) {
+            shard.listenDescriptor = socketDescriptor;
+        } else {
+            shard.listenDescriptor = socket(servInfo->ai_family, servInfo->ai_socktype | SOCK_NONBLOCK,
+                                            servInfo->ai_protocol);
+            if (shard.listenDescriptor == -1) {
+                serverErrorThrow("Unable to create listener: {}", strerror(errno));
+            }
+            setupListener(shard.listenDescriptor);
+        }
+        shard.eventLoop->addListener(shard.listenDescriptor);
+    }
+
+    if (!shardedAccept) {
+        listenLoop = socketHandler->createEventLoop(bufferSize);
+        listenLoop->addListener(socketDescriptor);
+        connectionListenThread = std::thread(&ServerSocket::connectionListenLoop, this);
+    }
+
+    for (auto &shard: shards) {
+        shard->thread = std::thread(&ServerSocket::workerLoop, this, std::ref(*shard));
+    }
+}
+
+void ServerSocket::setupListener(int descriptor) {
     int yes = 1;
-    // Forcefully attaching socket to the port 8080
-    Utils::throwIfError(getLogger(),
-                        setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT | SO_KEEPALIVE, &yes,
-                                   sizeof(yes)),
-                        SERVER_LOG_TAG);
+    // One option per call, the names are plain numbers rather than flags.
+    // Every sharded listener needs SO_REUSEPORT to bind the same port
+    for (int option: {SO_REUSEADDR, SO_REUSEPORT, SO_KEEPALIVE}) {
+        Utils::throwIfError(getLogger(), setsockopt(descriptor, SOL_SOCKET, option, &yes, sizeof(yes)),
+                            SERVER_LOG_TAG);
+    }
 
 //    O_NONBLOCK
 
     if (noDelay) {
         Utils::throwIfError(getLogger(),
-                            setsockopt(socketDescriptor, IPPROTO_TCP,
+                            setsockopt(descriptor, IPPROTO_TCP,
                                        TCP_NODELAY, &yes, sizeof(yes)),
                             SERVER_LOG_TAG);
     }
 
-    Utils::throwIfError(getLogger(), bind(socketDescriptor, servInfo->ai_addr, servInfo->ai_addrlen), SERVER_LOG_TAG);
-
-    connectionListenThread = std::thread(&ServerSocket::connectionListenLoop, this);
-
+    Utils::throwIfError(getLogger(), bind(descriptor, servInfo->ai_addr, servInfo->ai_addrlen), SERVER_LOG_TAG);
 
 //    if (int status = listen(socketDescriptor, BACKLOG) == -1) {
 //        perror("listen");
 //        Utils::throwIfError(status);
 //    }
-    Utils::throwIfError(getLogger(), listen(socketDescriptor, SOCKET_SERVER_BACKLOG), SERVER_LOG_TAG);
-
-    for (int i = 0; i < std::max(workerThreadCount, (uint16_t) 1); i++) {
-        workerThreads.emplace_back(&ServerSocket::readLoop, this);
-        workerThreads.emplace_back(&ServerSocket::writeLoop, this);
-    }
+    Utils::throwIfError(getLogger(), listen(descriptor, SOCKET_SERVER_BACKLOG), SERVER_LOG_TAG);
 }
 
 
 ServerSocket::~ServerSocket() {
     serverLog(LoggerLevel::DEBUG_LEVEL, "Deleting server socket");
     notifyStop();
-    for (auto it = clientDescriptors.begin(); it != clientDescriptors.end();) {
-        auto clientId = it->first;
-        // increment since closeClient removes from map
-        it++;
 
-        closeClient(clientId);
+    if (listenLoop) {
+        listenLoop->wakeup();
     }
 
     if (connectionListenThread.joinable()) {
         connectionListenThread.join();
     }
 
-    for (auto &t: workerThreads) {
-        if (t.joinable()) {
-            t.join();
+    for (auto &shard: shards) {
+        shard->eventLoop->wakeup();
+    }
+
+    for (auto &shard: shards) {
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+    }
+
+    // Workers are gone, nothing else touches the channels now
+    for (auto &shard: shards) {
+        int accepted;
+        while (shard->acceptedDescriptors.try_dequeue(accepted)) {
+            close(accepted);
+        }
+
+
+        std::vector<int> clientIds;
+        shard->channels.forEach([&clientIds](Channel &channel) {
+            clientIds.push_back(channel.clientDescriptor);
+        });
+
+        for (int clientId: clientIds) {
+            closeClient(*shard, clientId);
+        }
+
+        if (shard->listenDescriptor != -1 && shard->listenDescriptor != socketDescriptor) {
+            close(shard->listenDescriptor);
         }
     }
 
+    // Disconnect callbacks retire their channels
+    awaitCallbacks();
+
+    // Nothing is pinned anymore, this destroys every closed channel
+    reclaimer.collect();
+
     if (socketDescriptor != -1) {
         int status = shutdown(socketDescriptor, SHUT_RDWR);
 
@@ -91,66 +155,257 @@ ServerSocket::~ServerSocket() {
     serverLog(LoggerLevel::DEBUG_LEVEL, "Finish deleting server socket");
 }
 
-void ServerSocket::onConnectedClient(int clientDescriptor) {
-    std::unique_lock writeLock(clientDescriptorsMutex);
-    auto channel = std::make_unique<Channel>(*this, getLogger(), listenCallback, clientDescriptor);
+void ServerSocket::onConnectedClient(Shard &shard, int clientDescriptor) {
+    auto channel = std::make_unique<Channel>(*this, getLogger(), listenCallback, frameCallback, writabilityCallback,
+                                             clientDescriptor);
 
-    auto *channelPtr = clientDescriptors.emplace(clientDescriptor, std::move(channel)).first->second.get();
-    writeLock.unlock();
+    auto generation = nextGeneration.fetch_add(1, std::memory_order_relaxed);
+    if (generation == 0) {
+        // Wrapped around
+        generation = nextGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+    channel->handle = ChannelHandle(generation, shard.index, clientDescriptor);
 
-    if (connectCallback.empty()) {
-        return;
+    // Owned by the table until closeClient retires it
+    auto *channelPtr = channel.release();
+
+    // Dispatched before the channel is published, so it runs before a disconnect closing it concurrently.
+    // Held until the channel is published, the callback may look it up
+    channelPtr->strand->hold();
+    dispatchCallback(*channelPtr, [this, channelPtr] {
+        if (!connectCallback.empty()) {
+            connectCallback.invoke(*channelPtr, true);
+        }
+    });
+
+    // The channel stays on this loop until it is closed.
+    // Registered first so a concurrent closeClient unregisters it, we are the thread dispatching its events
+    shard.eventLoop->add(*channelPtr);
+
+    // Publishes the handle along with the channel
+    if (!shard.channels.insert(clientDescriptor, channelPtr)) {
+        serverLog(LoggerLevel::ERROR, "Descriptor {} does not fit the channel table, dropping the connection",
+                  clientDescriptor);
+        shard.eventLoop->remove(*channelPtr);
+
+        // Too late to take the connect callback back
+        dispatchCallback(*channelPtr, [this, channelPtr, clientDescriptor] {
+            if (!connectCallback.empty()) {
+                connectCallback.invoke(*channelPtr, false);
+            }
+            delete channelPtr;
+            close(clientDescriptor);
+        });
+    }
+
+    channelPtr->strand->release();
+}
+
+ServerSocket::Shard *ServerSocket::findShard(int clientDescriptor) {
+    for (auto &shard: shards) {
+        if (shard->channels.find(clientDescriptor) != nullptr) {
+            return shard.get();
+        }
+    }
+
+    return nullptr;
+}
+
+std::size_t ServerSocket::getClientCount() {
+    std::size_t count = 0;
+    for (auto &shard: shards) {
+        count += shard->channels.size();
     }
 
-    std::thread([channelPtr, this] {
-        connectCallback.invoke(*channelPtr, true);
-    }).detach();
+    return count;
 }
 
 void ServerSocket::write(int clientDescriptor, const Message &message) {
-    std::shared_lock readLock(clientDescriptorsMutex);
-    auto it = clientDescriptors.find(clientDescriptor);
+    auto guard = reclaimer.pin();
+    for (auto &shard: shards) {
+        if (auto *channel = shard->channels.find(clientDescriptor)) {
+            channel->queueWrite(message);
+            return;
+        }
+    }
 
-    if (it == clientDescriptors.end()) {
-        serverErrorThrow("Client descriptor {} does not exist", clientDescriptor);
+    serverErrorThrow("Client descriptor {} does not exist", clientDescriptor);
+}
+
+bool ServerSocket::write(ChannelHandle handle, const Message &message) {
+    auto guard = reclaimer.pin();
+    auto *channel = resolve(handle);
+
+    return channel != nullptr && channel->queueWrite(message);
+}
+
+bool ServerSocket::isConnected(ChannelHandle handle) {
+    auto guard = reclaimer.pin();
+    return resolve(handle) != nullptr;
+}
+
+void ServerSocket::joinGroup(std::string const &group, int clientDescriptor) {
+    auto guard = reclaimer.pin();
+    for (auto &shard: shards) {
+        auto *channel = shard->channels.find(clientDescriptor);
+        if (channel == nullptr) {
+            continue;
+        }
+
+        std::unique_lock groupsLock(groupsMutex);
+        groups[group][clientDescriptor] = channel;
+
+        // closeClient unlinks before it leaves groups, so if it ran in between the channel is gone from the table
+        if (shard->channels.find(clientDescriptor) != channel) {
+            auto it = groups.find(group);
+            it->second.erase(clientDescriptor);
+            if (it->second.empty()) {
+                groups.erase(it);
+            }
+            break;
+        }
+        return;
     }
-    auto &group = it->second;
 
-    group->queueWrite(message);
+    serverErrorThrow("Client descriptor {} does not exist", clientDescriptor);
+}
+
+void ServerSocket::leaveGroup(std::string const &group, int clientDescriptor) {
+    std::unique_lock groupsLock(groupsMutex);
+    auto it = groups.find(group);
+
+    if (it == groups.end()) {
+        return;
+    }
+
+    it->second.erase(clientDescriptor);
+    if (it->second.empty()) {
+        groups.erase(it);
+    }
+}
+
+void ServerSocket::leaveGroups(int clientDescriptor) {
+    std::unique_lock groupsLock(groupsMutex);
+
+    for (auto it = groups.begin(); it != groups.end();) {
+        it->second.erase(clientDescriptor);
+        it = it->second.empty() ? groups.erase(it) : std::next(it);
+    }
+}
+
+std::size_t ServerSocket::multicast(std::string const &group, const Message &message) {
+    auto const shared = message.toShared();
+    std::vector<Channel *> recipients;
+
+    // Members leave their groups before they're retired, so the ones copied here outlive the pin.
+    // Not queued under groupsMutex, a loop thread closing a channel waits for it
+    auto guard = reclaimer.pin();
+    {
+        std::shared_lock groupsLock(groupsMutex);
+        auto it = groups.find(group);
+
+        if (it == groups.end()) {
+            return 0;
+        }
+
+        recipients.reserve(it->second.size());
+        for (auto const &[id, channel]: it->second) {
+            recipients.push_back(channel);
+        }
+    }
+
+    std::erase_if(recipients, [&shared](Channel *channel) {
+        return !channel->enqueueWrite(shared, false);
+    });
+
+    // Members can be spread over every worker, wake each loop once for all of its channels
+    std::sort(recipients.begin(), recipients.end(), [](Channel *a, Channel *b) {
+        return std::less<EventLoop *>()(a->getEventLoop(), b->getEventLoop());
+    });
+
+    for (auto begin = recipients.begin(); begin != recipients.end();) {
+        auto *loop = (*begin)->getEventLoop();
+        auto end = std::find_if(begin, recipients.end(), [loop](Channel *channel) {
+            return channel->getEventLoop() != loop;
+        });
+
+        // Not registered yet, the loop flushes it once it is
+        if (loop != nullptr) {
+            loop->queueWritable(std::span(begin, end));
+        }
+        begin = end;
+    }
+
+    return recipients.size();
+}
+
+std::size_t ServerSocket::getGroupSize(std::string const &group) {
+    std::shared_lock groupsLock(groupsMutex);
+    auto it = groups.find(group);
+
+    return it == groups.end() ? 0 : it->second.size();
 }
 
 void ServerSocket::closeClient(int clientDescriptor) {
-    std::unique_lock writeLock(clientDescriptorsMutex);
-    auto it = clientDescriptors.find(clientDescriptor);
+    auto *shard = findShard(clientDescriptor);
 
-    if (it == clientDescriptors.end()) {
+    if (shard == nullptr || !closeClient(*shard, clientDescriptor)) {
         serverErrorThrow("Client descriptor {} does not exist", clientDescriptor);
-        return;
+    }
+}
+
+bool ServerSocket::closeClient(ChannelHandle handle) {
+    auto guard = reclaimer.pin();
+    if (resolve(handle) == nullptr) {
+        return false;
+    }
+
+    // The descriptor is only closed once we unpin, so no other client can take its slot meanwhile.
+    // If someone else closed it first, the remove fails
+    return closeClient(*shards[handle.shard()], handle.descriptor());
+}
+
+bool ServerSocket::closeClient(Shard &shard, int clientDescriptor) {
+    // Unlinked, but threads that already found it may use it until they unpin
+    auto *channelPtr = shard.channels.remove(clientDescriptor);
+
+    if (channelPtr == nullptr) {
+        return false;
     }
 
-    // Move to this scope
-    // Erase from map to avoid threads from reading it
-    //    channelWrapper = std::move(clientDescriptors.erase(it)->second);
-    // sadly no work :(
-    std::unique_ptr<Channel> channelWrapper;
-    it->second.swap(channelWrapper);
-    clientDescriptors.erase(it);
-    writeLock.unlock();
+    // Before the channel is retired, multicast may still be using it
+    leaveGroups(clientDescriptor);
 
-    Channel &channel = *channelWrapper;
-    if (!connectCallback.empty()) {
-        // TODO: Catch exceptions?
-        // TODO: Should we even use reference types here?
-        connectCallback.invoke(channel, false);
+    Channel &channel = *channelPtr;
+    if (auto eventLoop = channel.getEventLoop()) {
+        eventLoop->remove(channel);
     }
 
-    // Calls ~Channel()
-    // will wait for everything to close
-    // We release because a move calls the destructor
     shutdown(clientDescriptor, SHUT_RDWR);
-    close(clientDescriptor);
+
+    // Reads after this see the channel inactive
+    channel.queueShutdown();
+    if (dispatchListenEvents && channel.loopThread.load(std::memory_order_relaxed) != std::this_thread::get_id()) {
+        // A read in progress may be dispatching a listen event, which has to land before the disconnect
+        std::lock_guard readLock(channel.readLock);
+    }
+
+    // After the connect callback and anything else dispatched for the channel, which may still use it
+    dispatchCallback(channel, [this, channelPtr, clientDescriptor] {
+        if (!connectCallback.empty()) {
+            connectCallback.invoke(*channelPtr, false);
+        }
+
+        // ~Channel waits for everything to close.
+        // The descriptor is only closed with it, so it can't be reused while a stale lookup might still find the channel
+        reclaimer.retire([channelPtr, clientDescriptor] {
+            delete channelPtr;
+            close(clientDescriptor);
+        });
+    });
 
     serverLog(LoggerLevel::DEBUG_LEVEL, "Fully finished clearing client data from server memory.");
+    return true;
 }
 
 sockaddr_storage ServerSocket::getPeerName(int clientDescriptor) {
@@ -168,108 +423,158 @@ HostPort ServerSocket::getPeerAddress(int clientDescriptor) {
     return Utils::getHostByAddress(getLogger(), socketAddress);
 }
 
-// TODO: Replace with epoll
 void ServerSocket::connectionListenLoop() {
+    constexpr std::size_t maxEvents = 64;
+    IoEvent events[maxEvents];
+
     while (isActive()) {
-        this->threadLoop();
+        // Timeout only exists to notice notifyStop
+        auto eventCount = listenLoop->wait(events, std::chrono::milliseconds(100));
 
+        if (!isActive()) {
+            break;
+        }
+
+        for (auto const &event: std::span(events, eventCount)) {
+            if (event.completion == IoEvent::Completion::Accepted) {
+                handOff(static_cast<int>(event.result));
+                continue;
+            }
+
+            if (event.readable) {
+                acceptPending(socketDescriptor, nullptr);
+            }
+        }
+    }
+}
+
+void ServerSocket::acceptPending(int listenDescriptor, Shard *shard) {
+    while (isActive()) {
         struct sockaddr_storage their_addr{};
         socklen_t addr_size = sizeof their_addr;
-        int new_fd = accept4(socketDescriptor, (struct sockaddr *) &their_addr, &addr_size, SOCK_NONBLOCK);
+        int new_fd = accept4(listenDescriptor, (struct sockaddr *) &their_addr, &addr_size, SOCK_NONBLOCK);
 
         auto err = errno;
 
-        if (!isActive()) {
-            break;
-        }
-
         if (new_fd < 0) {
             // non block handle
             if (err == EWOULDBLOCK) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-
-                continue;
+                return;
             }
 
             Utils::logIfError(getLogger(), new_fd, "Failed to accept client", SERVER_LOG_TAG);
-            continue;
+            return;
         }
 
-        onConnectedClient(new_fd);
+        // Sharded listeners keep the connection on the worker that accepted it
+        if (shard != nullptr) {
+            onConnectedClient(*shard, new_fd);
+        } else {
+            handOff(new_fd);
+        }
     }
 }
 
-void ServerSocket::threadLoop() {
-    for (auto it = this->clientDescriptors.begin(); it != this->clientDescriptors.end();) {
-        auto const &[id, socket] = *it;
-        it++;
-        // increment before destroying in closeClient
-        if (socket->isActive()) {
-            continue;
-        }
+void ServerSocket::handOff(int clientDescriptor) {
+    // Round robin
+    auto &shard = *shards[nextShard++ % shards.size()];
+    shard.acceptedDescriptors.enqueue(clientDescriptor);
+    shard.eventLoop->wakeup();
+}
+
+void ServerSocket::closeInactive(Shard &shard) {
+    std::vector<int> inactive;
+    {
+        auto guard = reclaimer.pin();
+        shard.channels.forEach([&inactive](Channel &channel) {
+            if (!channel.isActive()) {
+                inactive.push_back(channel.clientDescriptor);
+            }
+        });
+    }
 
-        closeClient(socket->clientDescriptor);
+    for (int id: inactive) {
+        closeClient(shard, id);
     }
+
+    // Channels closed from other threads while pinned are destroyed here
+    reclaimer.collect();
 }
 
-void ServerSocket::writeLoop() {
+void ServerSocket::workerLoop(Shard &shard) {
+    if (pinWorkerThreads) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(shard.index % std::max(std::thread::hardware_concurrency(), 1u), &cpus);
+        // 0 is the calling thread
+        Utils::logIfError(getLogger(), sched_setaffinity(0, sizeof(cpus), &cpus), "Unable to pin worker",
+                          SERVER_LOG_TAG);
+    }
+
     byte buf[bufferSize];
     std::span byteSpan(buf, bufferSize);
 
+    constexpr std::size_t maxEvents = 64;
+    IoEvent events[maxEvents];
+
+    // Interval for reaping closed channels
+    constexpr auto sweepInterval = std::chrono::milliseconds(50);
+    auto nextSweep = std::chrono::steady_clock::now() + sweepInterval;
+
+    auto &eventLoop = *shard.eventLoop;
     auto logToken = this->getLogger().createProducerToken();
     while (isActive()) {
-        auto sleepTime = std::chrono::microseconds(std::max(this->clientDescriptors.size() * 50, (std::size_t) 500));
-        bool foundWritableChannel = false;
+        auto eventCount = eventLoop.wait(events, sweepInterval);
 
-        {
-            std::shared_lock readLock(clientDescriptorsMutex);
-            for (auto it = this->clientDescriptors.begin(); it != this->clientDescriptors.end();) {
-                auto &channel = it->second;
-                it++;
-                if (!channel->isActive()) {
-                    continue;
-                }
-
-                foundWritableChannel |= channel->handleWriteQueue(logToken);
-            }
+        if (!isActive()) {
+            break;
         }
 
-        if (!foundWritableChannel) {
-            std::this_thread::yield();
-            std::this_thread::sleep_for(sleepTime);
+        // Accept before dispatching, so events for new channels find them
+        int accepted;
+        while (shard.acceptedDescriptors.try_dequeue(accepted)) {
+            onConnectedClient(shard, accepted);
         }
-    }
-}
-
-void ServerSocket::readLoop() {
-    byte buf[bufferSize];
-    std::span byteSpan(buf, bufferSize);
 
-    auto logToken = this->getLogger().createProducerToken();
-    while (isActive()) {
-        auto sleepTime = std::chrono::microseconds(std::max(this->clientDescriptors.size() * 50, (std::size_t) 500));
+        if (shard.listenDescriptor != -1) {
+            for (auto const &event: std::span(events, eventCount)) {
+                if (event.fd != shard.listenDescriptor) {
+                    continue;
+                }
 
-        bool foundReadableChannel = false;
+                if (event.completion == IoEvent::Completion::Accepted) {
+                    onConnectedClient(shard, static_cast<int>(event.result));
+                } else if (event.readable) {
+                    acceptPending(shard.listenDescriptor, &shard);
+                }
+            }
+        }
 
         {
-            std::shared_lock readLock(clientDescriptorsMutex);
-            for (auto it = this->clientDescriptors.begin(); it != this->clientDescriptors.end();) {
-                auto &channel = it->second;
-                it++;
-                if (!channel->isActive()) {
+            // Channels closed meanwhile stay alive until the end of the dispatch
+            auto guard = reclaimer.pin();
+            for (auto const &event: std::span(events, eventCount)) {
+                auto *channel = shard.channels.find(event.fd);
+                if (channel == nullptr || !channel->isActive()) {
                     continue;
                 }
 
-
-                foundReadableChannel |= channel->readData(byteSpan, logToken);
+                channel->handleEvent(event, byteSpan, logToken);
             }
-        }
 
+            eventLoop.drainWritable([&](int fd) {
+                auto *channel = shard.channels.find(fd);
+                if (channel == nullptr || !channel->isActive()) {
+                    return;
+                }
 
-        if (!foundReadableChannel) {
-            std::this_thread::yield();
-            std::this_thread::sleep_for(sleepTime);
+                channel->handleScheduledWrite(logToken);
+            });
+        }
+
+        if (auto now = std::chrono::steady_clock::now(); now >= nextSweep) {
+            closeInactive(shard);
+            nextSweep = now + sweepInterval;
         }
     }
 }
-
@@ -9,12 +9,26 @@
 #include <netdb.h>
 #include <iostream>
 
+#include <algorithm>
+#include <climits>
+#include <iterator>
 #include <span>
 #include <utility>
 #include <fcntl.h>
 
 using namespace SocketLib;
 
+namespace {
+    // Per call site, for logs that fire once per channel and so flood during disconnect storms
+    constexpr uint32_t CHANNEL_LOGS_PER_SECOND = 10;
+    constexpr uint32_t CHANNEL_LOG_BURST = 20;
+
+    // Frames missing less than this complete within a wakeup or two, not worth the setsockopt
+    constexpr std::size_t MIN_RECEIVE_LOW_WATERMARK = 16 * 1024;
+    // The kernel caps it at half the receive buffer anyway
+    constexpr std::size_t MAX_RECEIVE_LOW_WATERMARK = 4 * 1024 * 1024;
+}
+
 SocketLib::Socket::Socket(SocketHandler *socketHandler, uint32_t id, std::optional<std::string> address, uint32_t port)
         : id(id), socketHandler(socketHandler), host(std::move(address)), port(port) {
     servInfo = Utils::resolveEndpoint(getLogger(), host ? host->c_str() : nullptr, std::to_string(port).c_str());
@@ -69,12 +83,47 @@ Logger &Socket::getLogger() {
     return socketHandler->getLogger();
 }
 
-Channel::Channel(Socket const &socket, Logger &logger, ListenEventCallback &listenCallback, int clientDescriptor) :
+void Socket::dispatchCallback(Channel &channel, WorkT work) {
+    pendingCallbacks.fetch_add(1, std::memory_order_acq_rel);
+
+    channel.strand->post([this, work = std::move(work)] {
+        // The executor logs the exception, it must still count as finished
+        try {
+            work();
+        } catch (...) {
+            finishCallback();
+            throw;
+        }
+        finishCallback();
+    });
+}
+
+void Socket::finishCallback() {
+    if (pendingCallbacks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::unique_lock lock(callbacksMutex);
+        callbacksDone.notify_all();
+    }
+}
+
+void Socket::awaitCallbacks() {
+    std::unique_lock lock(callbacksMutex);
+    callbacksDone.wait(lock, [this] {
+        return pendingCallbacks.load(std::memory_order_acquire) == 0;
+    });
+}
+
+Channel::Channel(Socket const &socket, Logger &logger, ListenEventCallback &listenCallback,
+                 FrameEventCallback &frameCallback, WritabilityEventCallback &writabilityCallback,
+                 int clientDescriptor) :
         clientDescriptor(clientDescriptor),
         active(true),
+        strand(std::make_shared<Strand>(socket.getSocketHandler()->getCallbackExecutor())),
         socket(socket),
         logger(logger),
         listenCallback(listenCallback),
+        frameCallback(frameCallback),
+        writabilityCallback(writabilityCallback),
+        frameDecoder(socket.framing),
         writeConsumeToken(writeQueue) {
 }
 
@@ -82,22 +131,288 @@ Logger &Channel::getLogger() {
     return logger;
 }
 
-void Channel::queueWrite(const Message &msg) {
+bool Channel::queueWrite(const Message &msg) {
+    if (!enqueueWrite(msg)) {
+        return false;
+    }
+
+    scheduleFlush();
+    return true;
+}
+
+bool Channel::queueWrite(Message &&msg) {
+    if (!enqueueWrite(std::move(msg))) {
+        return false;
+    }
+
+    scheduleFlush();
+    return true;
+}
+
+void Channel::scheduleFlush() {
+    if (auto loop = eventLoop.load(std::memory_order_acquire)) {
+        loop->queueWritable(*this);
+    }
+}
+
+bool Channel::enqueueWrite(const Message &msg, bool mayBlock) {
+    if (!acceptWrite(msg, mayBlock)) {
+        return false;
+    }
+
+    writeQueue.enqueue(msg);
+    return true;
+}
+
+bool Channel::enqueueWrite(Message &&msg) {
+    if (!acceptWrite(msg, true)) {
+        return false;
+    }
+
+    writeQueue.enqueue(std::move(msg));
+    return true;
+}
+
+bool Channel::acceptWrite(const Message &msg, bool mayBlock) {
     if (!active) {
-        return;
+        return false;
     }
 
     if (msg.data() == nullptr || msg.length() == 0) {
+        return false;
+    }
+
+    return reserveWrite(msg.length(), mayBlock);
+}
+
+bool Channel::exceedsLimit(std::size_t bytes) const {
+    auto const &limits = socket.writeLimits;
+    auto const queuedBytes = pendingBytes.load(std::memory_order_relaxed);
+
+    // A message bigger than the limit still goes through once the channel is drained
+    return (limits.maxBytes != 0 && queuedBytes != 0 && queuedBytes + bytes > limits.maxBytes) ||
+           (limits.maxMessages != 0 && pendingMessages.load(std::memory_order_relaxed) >= limits.maxMessages);
+}
+
+bool Channel::reserveWrite(std::size_t bytes, bool mayBlock) {
+    auto const &limits = socket.writeLimits;
+
+    if (exceedsLimit(bytes)) {
+        switch (limits.overflowPolicy) {
+            case WriteOverflowPolicy::Drop: {
+                static RateLimit limit(CHANNEL_LOGS_PER_SECOND, CHANNEL_LOG_BURST);
+                getLogger().fmtLog<LoggerLevel::DEBUG_LEVEL>(limit, CHANNEL_LOG_TAG,
+                                                             "Write queue of {} is full, dropping message",
+                                                             clientDescriptor);
+                return false;
+            }
+            case WriteOverflowPolicy::Disconnect: {
+                static RateLimit limit(CHANNEL_LOGS_PER_SECOND, CHANNEL_LOG_BURST);
+                getLogger().fmtLog<LoggerLevel::WARN>(limit, CHANNEL_LOG_TAG, "Write queue of {} is full, disconnecting",
+                                                      clientDescriptor);
+                this->queueShutdown();
+                return false;
+            }
+            case WriteOverflowPolicy::Block: {
+                // Fan out holds up every other recipient, and may hold locks the loop thread needs to drain us
+                if (!mayBlock) {
+                    static RateLimit limit(CHANNEL_LOGS_PER_SECOND, CHANNEL_LOG_BURST);
+                    getLogger().fmtLog<LoggerLevel::DEBUG_LEVEL>(limit, CHANNEL_LOG_TAG,
+                                                                 "Write queue of {} is full, dropping fanned out message",
+                                                                 clientDescriptor);
+                    return false;
+                }
+
+                // Nobody would drain the queue while we wait
+                if (loopThread.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+                    static RateLimit limit(CHANNEL_LOGS_PER_SECOND, CHANNEL_LOG_BURST);
+                    getLogger().fmtLog<LoggerLevel::WARN>(limit, CHANNEL_LOG_TAG,
+                                                          "Write queue of {} is full and blocking on its loop thread would deadlock, dropping message",
+                                                          clientDescriptor);
+                    return false;
+                }
+
+                std::unique_lock lock(drainMutex);
+                blockedWriters.fetch_add(1, std::memory_order_acq_rel);
+                // Timeout so a channel closing underneath us is noticed
+                while (isActive() && exceedsLimit(bytes)) {
+                    drained.wait_for(lock, std::chrono::milliseconds(50));
+                }
+                blockedWriters.fetch_sub(1, std::memory_order_acq_rel);
+
+                if (!isActive()) {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+
+    auto const messages = pendingMessages.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto const total = pendingBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+    bool const aboveHigh = (limits.highWatermarkBytes != 0 && total > limits.highWatermarkBytes) ||
+                           (limits.highWatermarkMessages != 0 && messages > limits.highWatermarkMessages);
+
+    if (aboveHigh && writable.exchange(false, std::memory_order_acq_rel)) {
+        notifyWritability(false);
+    }
+
+    return true;
+}
+
+void Channel::releaseWrite(std::size_t bytes, std::size_t messages) {
+    auto const &limits = socket.writeLimits;
+
+    auto const total = pendingBytes.fetch_sub(bytes, std::memory_order_relaxed) - bytes;
+    auto const remaining = pendingMessages.fetch_sub(messages, std::memory_order_relaxed) - messages;
+
+    bool const belowLow = (limits.highWatermarkBytes == 0 || total <= limits.lowWatermarkBytes) &&
+                          (limits.highWatermarkMessages == 0 || remaining <= limits.lowWatermarkMessages);
+
+    if (belowLow && !writable.load(std::memory_order_relaxed) && !writable.exchange(true, std::memory_order_acq_rel)) {
+        notifyWritability(true);
+    }
+
+    if (blockedWriters.load(std::memory_order_acquire) > 0) {
+        std::lock_guard lock(drainMutex);
+        drained.notify_all();
+    }
+}
+
+void Channel::notifyWritability(bool isWritable) {
+    if (writabilityCallback.empty()) {
+        return;
+    }
+
+    writabilityCallback.invokeError(*this, isWritable, [this](auto const &e) constexpr {
+        getLogger().fmtLog<LoggerLevel::ERROR>(CHANNEL_LOG_TAG, "Exception caught in writability listener: {}",
+                                               e.what());
+    });
+}
+
+void Channel::dispatchReceived(std::span<byte> bytes) {
+    {
+        std::unique_lock lock(stagingMutex);
+        incomingQueue.enqueueMove(bytes);
+
+        // The scheduled delivery picks these up too
+        if (deliveryScheduled) {
+            return;
+        }
+        deliveryScheduled = true;
+    }
+
+    // Not counted by the socket, the disconnect callback is dispatched after it and keeps the channel alive
+    strand->post([this] {
+        deliverReceived();
+    });
+}
+
+void Channel::deliverReceived() {
+    {
+        std::unique_lock lock(stagingMutex);
+        dispatchedQueue.splice(incomingQueue);
+        deliveryScheduled = false;
+    }
+
+    if (socket.framing.format != FrameFormat::None) {
+        [[maybe_unused]] auto valid = receiveFrames(dispatchedQueue, {});
         return;
     }
-    if (std::this_thread::get_id() != writeThread.get_id()) {
-        writeQueue.enqueue(msg);
+
+    if (listenCallback.empty() || dispatchedQueue.queueSize() == 0) {
         return;
     }
 
+    listenCallback.invokeError(*this, dispatchedQueue, [this](auto const &e) constexpr {
+        getLogger().fmtLog<LoggerLevel::ERROR>(CHANNEL_LOG_TAG, "Exception caught in listener: {}", e.what());
+    });
+}
 
-    // TODO: Immediately send only if queue empty? If not, queue up when there's work on the queue
-    sendMessage(msg);
+bool Channel::receiveFrames(StreamQueue &pending, std::span<byte> bytes) {
+    auto const valid = frameDecoder.decode(pending, bytes, [this](std::span<const uint8_t> frame) {
+        frameCallback.invokeError(*this, frame, [this](auto const &e) constexpr {
+            getLogger().fmtLog<LoggerLevel::ERROR>(CHANNEL_LOG_TAG, "Exception caught in frame listener: {}",
+                                                   e.what());
+        });
+    });
+
+    if (!valid) {
+        static RateLimit limit(CHANNEL_LOGS_PER_SECOND, CHANNEL_LOG_BURST);
+        getLogger().fmtLog<LoggerLevel::WARN>(limit, CHANNEL_LOG_TAG,
+                                              "Closing {} because it sent a malformed frame header or a frame over {} bytes",
+                                              clientDescriptor, socket.framing.maxFrameSize);
+        this->queueShutdown();
+    }
+
+    return valid;
+}
+
+void Channel::updateReceiveLowWatermark() {
+    auto const &framing = socket.framing;
+    if (framing.format == FrameFormat::None || !framing.receiveLowWatermark || socket.dispatchListenEvents) {
+        return;
+    }
+
+    // Multishot receives complete without checking it again, a stale one could hold back the frame's last bytes
+    auto *loop = getEventLoop();
+    if (loop == nullptr || loop->completionBased()) {
+        return;
+    }
+
+    auto const missing = frameDecoder.missingBytes(incomingQueue);
+    auto const target = missing >= MIN_RECEIVE_LOW_WATERMARK
+                        ? static_cast<int>(std::min(missing, MAX_RECEIVE_LOW_WATERMARK)) : 0;
+    if (target == receiveLowWatermark) {
+        return;
+    }
+
+    // The kernel checks it against what is already queued as it's set, so nothing that arrived meanwhile is missed
+    int const value = std::max(target, 1);
+    if (setsockopt(clientDescriptor, SOL_SOCKET, SO_RCVLOWAT, &value, sizeof(value)) == 0) {
+        receiveLowWatermark = target;
+    }
+}
+
+void Channel::handleEvent(IoEvent const &event, std::span<byte> byteBuf, moodycamel::ProducerToken const &logToken) {
+    loopThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+    switch (event.completion) {
+        case IoEvent::Completion::Received: {
+            receiveEvents.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard lock(readLock);
+            // Completions carry -errno instead of setting errno
+            [[maybe_unused]] auto read = handleReceived(event.result, event.result < 0 ? (int) -event.result : 0,
+                                                        event.data, logToken);
+            return;
+        }
+        case IoEvent::Completion::Sent:
+            handleSent(event.result, logToken);
+            return;
+        default:
+            break;
+    }
+
+    if (event.readable || event.hangup) {
+        receiveEvents.fetch_add(1, std::memory_order_relaxed);
+        // Drain until EWOULDBLOCK, we won't be notified again otherwise
+        while (readData(byteBuf, logToken)) {}
+    }
+
+    if (event.writable) {
+        // Room in the send buffer again, resume whatever was parked
+        writeBlocked = false;
+        [[maybe_unused]] auto wrote = handleWriteQueue(logToken);
+    }
+}
+
+void Channel::handleScheduledWrite(moodycamel::ProducerToken const &logToken) {
+    loopThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+    // Clear first so writes queued while flushing schedule another pass
+    writeScheduled.store(false, std::memory_order_release);
+    [[maybe_unused]] auto wrote = handleWriteQueue(logToken);
 }
 
 bool Channel::readData(std::span<byte> byteBuf, moodycamel::ProducerToken const &logToken) {
@@ -110,11 +425,16 @@ bool Channel::readData(std::span<byte> byteBuf, moodycamel::ProducerToken const
 
     // don't lock since try_lock already locked
     std::lock_guard lock(readLock, std::adopt_lock);
-    try {
-        long recv_bytes = recv(clientDescriptor, byteBuf.data(), byteBuf.size(), MSG_DONTWAIT);
 
-        int err = errno;
+    long recv_bytes = recv(clientDescriptor, byteBuf.data(), byteBuf.size(), MSG_DONTWAIT);
+    int err = errno;
 
+    return handleReceived(recv_bytes, err, byteBuf, logToken);
+}
+
+bool Channel::handleReceived(long recv_bytes, int err, std::span<byte> byteBuf,
+                             moodycamel::ProducerToken const &logToken) {
+    try {
         if (!isActive()) {
             return false;
         }
@@ -135,6 +455,7 @@ bool Channel::readData(std::span<byte> byteBuf, moodycamel::ProducerToken const
             }
 
             if (err == EWOULDBLOCK) {
+                updateReceiveLowWatermark();
                 return false;
             }
 
@@ -147,20 +468,29 @@ bool Channel::readData(std::span<byte> byteBuf, moodycamel::ProducerToken const
         // Success
         // offset 0 len recv_bytes
 
+        if (socket.dispatchListenEvents) {
+            dispatchReceived(byteBuf.subspan(0, recv_bytes));
+            return true;
+        }
+
+        if (socket.framing.format != FrameFormat::None) {
+            return receiveFrames(incomingQueue, byteBuf.subspan(0, recv_bytes));
+        }
+
         incomingQueue.enqueueMove(byteBuf.subspan(0, recv_bytes));
 
         if (!listenCallback.empty()) {
             listenCallback.invokeError(*this, incomingQueue, [&logToken, this](auto const &e) constexpr {
-                getLogger().writeLog<LoggerLevel::ERROR>(logToken, CHANNEL_LOG_TAG,
-                                                         fmt::format("Exception caught in listener: {}",
-                                                                     e.what()));
+                getLogger().fmtLog<LoggerLevel::ERROR>(logToken, CHANNEL_LOG_TAG, "Exception caught in listener: {}",
+                                                       e.what());
             });
         }
 
         // success got data
         return true;
     } catch (std::exception const &e) {
-        getLogger().fmtLog<LoggerLevel::ERROR>(logToken, CHANNEL_LOG_TAG,
+        static RateLimit limit(CHANNEL_LOGS_PER_SECOND, CHANNEL_LOG_BURST);
+        getLogger().fmtLog<LoggerLevel::ERROR>(limit, CHANNEL_LOG_TAG,
                                                "Closing socket because it has crashed fatally while reading: {}",
                                                e.what());
         this->queueShutdown();
@@ -178,8 +508,12 @@ bool Channel::handleWriteQueue(moodycamel::ProducerToken const &logToken) {
         return false;
     }
 
-    // TODO: Should be done?
-    if (writeQueue.size_approx() == 0) return false;
+    auto *loop = getEventLoop();
+    bool const completionBased = loop != nullptr && loop->completionBased();
+
+    // Nothing to send, or the kernel buffer is full and the next writable event resumes us
+    if (writeQueue.size_approx() == 0 && outbound->messages.empty()) return false;
+    if (writeBlocked) return false;
 
     // don't lock since try_lock already locked
     std::unique_lock lock(writeLock, std::try_to_lock);
@@ -189,23 +523,21 @@ bool Channel::handleWriteQueue(moodycamel::ProducerToken const &logToken) {
     }
 
     try {
-        auto constexpr messageReserve = 10;
-        Message messages[messageReserve];
-
-
-        auto dequeCount = writeQueue.wait_dequeue_bulk_timed(writeConsumeToken, messages, messageReserve,
-                                                             std::chrono::microseconds (100));
-        if (dequeCount == 0) {
-            return false;
+        if (completionBased) {
+            return submitWriteQueue(*loop);
         }
 
-        for (size_t i = 0; i < dequeCount; i++) {
-            sendMessage(messages[i]);
+        bool wrote = false;
+
+        // Readiness is edge triggered, so drain everything we have now
+        while (isActive() && !writeBlocked && fillOutbound() > 0) {
+            wrote |= sendOutbound();
         }
 
-        return true;
+        return wrote;
     } catch (std::exception const &e) {
-        getLogger().fmtLog<LoggerLevel::ERROR>(logToken, CHANNEL_LOG_TAG,
+        static RateLimit limit(CHANNEL_LOGS_PER_SECOND, CHANNEL_LOG_BURST);
+        getLogger().fmtLog<LoggerLevel::ERROR>(limit, CHANNEL_LOG_TAG,
                                                "Closing socket because it has crashed fatally while writing: {}",
                                                e.what());
         this->queueShutdown();
@@ -218,40 +550,136 @@ bool Channel::handleWriteQueue(moodycamel::ProducerToken const &logToken) {
     return false;
 }
 
-void Channel::sendMessage(const Message &message) {
-    sendBytes(message);
+bool Channel::submitWriteQueue(EventLoop &loop) {
+    // One send in flight at a time keeps the stream ordered
+    if (sendInFlight) {
+        return false;
+    }
+
+    if (fillOutbound() == 0) {
+        return false;
+    }
+
+    // If the loop can't take it right now it reschedules us on its next wait
+    gatherOutbound();
+    sendInFlight = loop.submitSend(*this, outbound);
+
+    return sendInFlight;
+}
+
+void Channel::handleSent(long result, moodycamel::ProducerToken const &logToken) {
+    std::unique_lock lock(writeLock);
+    sendInFlight = false;
+
+    if (result < 0) {
+        if (result == -EAGAIN || result == -EINTR) {
+            lock.unlock();
+            [[maybe_unused]] auto wrote = handleWriteQueue(logToken);
+            return;
+        }
+
+        static RateLimit limit(CHANNEL_LOGS_PER_SECOND, CHANNEL_LOG_BURST);
+        getLogger().fmtLog<LoggerLevel::ERROR>(limit, CHANNEL_LOG_TAG,
+                                               "Closing socket because it has crashed fatally while writing: {}",
+                                               strerror((int) -result));
+        this->queueShutdown();
+        return;
+    }
+
+    consumeOutbound(result);
+
+    lock.unlock();
+    [[maybe_unused]] auto wrote = handleWriteQueue(logToken);
+}
+
+std::size_t Channel::fillOutbound() {
+    auto const batchSize = std::clamp<std::size_t>(socket.writeBatchSize, 1, IOV_MAX);
+
+    auto &messages = outbound->messages;
+    if (messages.size() < batchSize) {
+        writeQueue.try_dequeue_bulk(writeConsumeToken, std::back_inserter(messages), batchSize - messages.size());
+    }
+
+    return messages.size();
+}
+
+void Channel::gatherOutbound() {
+    auto &batch = *outbound;
+    auto const count = std::min<std::size_t>(batch.messages.size(), IOV_MAX);
+
+    batch.iov.resize(count);
+    for (std::size_t i = 0; i < count; i++) {
+        auto bytes = batch.messages[i].toSpan();
+        if (i == 0) {
+            bytes = bytes.subspan(outboundOffset);
+        }
+
+        batch.iov[i] = iovec{const_cast<byte *>(bytes.data()), bytes.size()};
+    }
+
+    batch.header = msghdr{};
+    batch.header.msg_iov = batch.iov.data();
+    batch.header.msg_iovlen = batch.iov.size();
+}
+
+void Channel::consumeOutbound(std::size_t sent) {
+    auto const sentBytes = sent;
+    std::size_t finished = 0;
+
+    // A partial write may end anywhere, including in the middle of a later message
+    auto &messages = outbound->messages;
+    while (sent > 0 && !messages.empty()) {
+        auto const remaining = messages.front().length() - outboundOffset;
+        if (sent < remaining) {
+            outboundOffset += sent;
+            break;
+        }
+
+        sent -= remaining;
+        messages.pop_front();
+        outboundOffset = 0;
+        finished++;
+    }
+
+    releaseWrite(sentBytes, finished);
 }
 
-void Channel::sendBytes(std::span<const byte> bytes) {
+bool Channel::sendOutbound() {
     // Throw exception here?
     if (!active || !socket.isActive()) {
         getLogger().writeLog<LoggerLevel::WARN>(CHANNEL_LOG_TAG, "Sending data when socket isn't active, why?");
-        return;
+        return false;
     }
 
-    long sent_bytes = 0;
-    while (sent_bytes < bytes.size()) {
+    bool wrote = false;
+    while (!outbound->messages.empty()) {
         if (!isActive()) {
             break;
         }
 
-        sent_bytes = send(clientDescriptor, bytes.data(), bytes.size(), MSG_DONTWAIT);
+        gatherOutbound();
+        long sent_bytes = sendmsg(clientDescriptor, &outbound->header, MSG_DONTWAIT | MSG_NOSIGNAL);
         int err = errno;
 
-        // Queue up remaining data
         if (sent_bytes < 0) {
-            if (err == EWOULDBLOCK) {
-                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            if (err == EINTR) {
                 continue;
             }
+            // Park the rest in outbound, the loop reports the channel writable once the peer catches up
+            if (err == EWOULDBLOCK) {
+                writeBlocked = true;
+                break;
+            }
             this->queueShutdown();
             Utils::throwIfError<true>(getLogger(), err, CHANNEL_LOG_TAG);
             break;
         }
-        if (sent_bytes < bytes.size()) {
-            bytes = bytes.subspan(sent_bytes);
-        }
+
+        consumeOutbound(sent_bytes);
+        wrote = true;
     }
+
+    return wrote;
 }
 
 Channel::~Channel() {
@@ -267,23 +695,14 @@ bool Channel::isActive() const {
 
 /// When the owning socket sees the active false bool, the channel will be deleted
 void Channel::queueShutdown() {
-    getLogger().fmtLog<LoggerLevel::DEBUG_LEVEL>(CHANNEL_LOG_TAG, "Queing shutdown for {}", socket.id);
+    static RateLimit limit(CHANNEL_LOGS_PER_SECOND, CHANNEL_LOG_BURST);
+    getLogger().fmtLog<LoggerLevel::DEBUG_LEVEL>(limit, CHANNEL_LOG_TAG, "Queing shutdown for {}", socket.id);
     active = false;
 }
 
 void Channel::awaitShutdown() {
     queueShutdown();
 
-    if (readThread.joinable()) {
-        getLogger().writeLog<LoggerLevel::DEBUG_LEVEL>(CHANNEL_LOG_TAG, "Read detach");
-        readThread.join();
-    }
-
-    if (writeThread.joinable()) {
-        getLogger().writeLog<LoggerLevel::DEBUG_LEVEL>(CHANNEL_LOG_TAG, "Write wait end");
-        writeThread.join();
-    }
-
     // Wait for these to unlock
     std::lock(readLock, writeLock);
     readLock.unlock();
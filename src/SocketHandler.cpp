@@ -1,4 +1,6 @@
 #include "SocketHandler.hpp"
+#include "EpollEventLoop.hpp"
+#include "IoUringEventLoop.hpp"
 #include <iostream>
 
 using namespace SocketLib;
@@ -43,6 +45,33 @@ void SocketLib::SocketHandler::destroySocket(uint32_t id) {
     }
 }
 
+std::unique_ptr<EventLoop> SocketHandler::createEventLoop(uint32_t bufferSize) {
+#ifdef SOCKETLIB_IO_URING
+    if (ioBackend == IoBackend::IoUring) {
+        try {
+            return std::make_unique<IoUringEventLoop>(logger, bufferSize);
+        } catch (std::exception const &e) {
+            // Seccomp filters (Android) and old kernels refuse io_uring, epoll works everywhere
+            logger.fmtLog<LoggerLevel::WARN>(SOCKET_HANDLER_LOG_TAG, "Falling back to epoll: {}", e.what());
+        }
+    }
+#else
+    if (ioBackend == IoBackend::IoUring) {
+        logger.writeLog<LoggerLevel::WARN>(SOCKET_HANDLER_LOG_TAG, "Built without io_uring, falling back to epoll");
+    }
+#endif
+
+    return std::make_unique<EpollEventLoop>(logger);
+}
+
+CallbackExecutor &SocketHandler::getCallbackExecutor() {
+    std::call_once(callbackExecutorOnce, [this] {
+        callbackExecutor = std::make_unique<CallbackExecutor>(logger, callbackThreadCount, maxQueuedCallbacks);
+    });
+
+    return *callbackExecutor;
+}
+
 void SocketHandler::handleLogThread() {
 #ifndef SOCKETLIB_PAPER_LOG
     moodycamel::ConsumerToken consumerToken(logger.logQueue);
@@ -51,7 +80,10 @@ void SocketHandler::handleLogThread() {
     Logger::LogTask logTasks[taskCount];
 
     while (active) {
-        auto dequeCount = logger.logQueue.wait_dequeue_bulk_timed(consumerToken, logTasks, taskCount, std::chrono::milliseconds(100));
+        // Deferred records aren't signalled, so don't wait on the queue too long between polls of the rings
+        auto dequeCount = logger.logQueue.wait_dequeue_bulk_timed(consumerToken, logTasks, taskCount, std::chrono::milliseconds(20));
+        logger.drainDeferred();
+
         if (dequeCount == 0) {
             std::this_thread::yield();
             std::this_thread::sleep_for(std::chrono::milliseconds(10));
@@ -82,5 +114,8 @@ SocketHandler::~SocketHandler() {
         loggerThread.detach();
     }
     sockets.clear();
+
+    // Sockets waited for their callbacks, nothing is queued anymore
+    callbackExecutor.reset();
 }
 
@@ -1,6 +1,159 @@
 #include "SocketLogger.hpp"
 
+#include <algorithm>
+
 using namespace SocketLib;
+
+namespace {
+std::atomic_uint64_t loggerIds = 1;
+
+/// Rings this thread writes deferred logs to, one per logger
+struct ThreadRings {
+  struct Entry {
+    uint64_t loggerId;
+    std::shared_ptr<LogRing> ring;
+  };
+
+  std::vector<Entry> entries;
+  Entry *last = nullptr;
+
+  ~ThreadRings();
+};
+
+thread_local ThreadRings threadRings;
+// Logs from thread_local destructors running after ours are formatted eagerly
+thread_local bool threadRingsDestroyed = false;
+
+ThreadRings::~ThreadRings() {
+  for (auto &entry : entries) {
+    entry.ring->abandoned.store(true, std::memory_order_release);
+  }
+  threadRingsDestroyed = true;
+}
+} // namespace
+
+Logger::Logger() {
+  for (auto &level : tagLevels) {
+    level.store(static_cast<uint8_t>(LoggerLevel::DEBUG_LEVEL), std::memory_order_relaxed);
+  }
+}
+
+void Logger::setLevel(std::string_view tag, LoggerLevel minimum) {
+  auto const tagId = detail::internLogTag(tag);
+  if (tagId >= MAX_LEVEL_TAGS) {
+    fmtLog<LoggerLevel::WARN>(tag, "Too many tags to give {} its own level", tag);
+    return;
+  }
+
+  std::unique_lock lock(levelsMutex);
+  explicitLevels.set(tagId);
+  tagLevels[tagId].store(static_cast<uint8_t>(minimum), std::memory_order_relaxed);
+}
+
+void Logger::resetLevel(std::string_view tag) {
+  auto const tagId = detail::internLogTag(tag);
+  if (tagId >= MAX_LEVEL_TAGS) {
+    return;
+  }
+
+  std::unique_lock lock(levelsMutex);
+  explicitLevels.reset(tagId);
+  tagLevels[tagId].store(defaultLevel.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void Logger::setDefaultLevel(LoggerLevel minimum) {
+  std::unique_lock lock(levelsMutex);
+  defaultLevel.store(static_cast<uint8_t>(minimum), std::memory_order_relaxed);
+
+  // Copied into every other tag's slot, so checking a level stays a single load
+  for (std::size_t tagId = 0; tagId < MAX_LEVEL_TAGS; tagId++) {
+    if (!explicitLevels.test(tagId)) {
+      tagLevels[tagId].store(static_cast<uint8_t>(minimum), std::memory_order_relaxed);
+    }
+  }
+}
+
+LoggerLevel Logger::getLevel(std::string_view tag) const {
+  auto const tagId = detail::internLogTag(tag);
+  auto const &minimum = tagId < MAX_LEVEL_TAGS ? tagLevels[tagId] : defaultLevel;
+  return static_cast<LoggerLevel>(minimum.load(std::memory_order_relaxed));
+}
+
+uint64_t Logger::nextLoggerId() {
+  return loggerIds.fetch_add(1, std::memory_order_relaxed);
+}
+
+LogRing *Logger::threadRing() {
+  if (threadRingsDestroyed) {
+    return nullptr;
+  }
+
+  auto &cache = threadRings;
+  if (cache.last != nullptr && cache.last->loggerId == id) {
+    return cache.last->ring.get();
+  }
+
+  auto it = std::find_if(cache.entries.begin(), cache.entries.end(),
+                         [this](auto const &entry) { return entry.loggerId == id; });
+
+  if (it == cache.entries.end()) {
+    // Rings only we still hold belong to destroyed loggers, ids are never reused
+    std::erase_if(cache.entries, [](auto const &entry) { return entry.ring.use_count() == 1; });
+
+    auto ring = std::make_shared<LogRing>();
+    {
+      std::unique_lock lock(ringsMutex);
+      rings.emplace_back(ring);
+    }
+
+    cache.entries.push_back({id, std::move(ring)});
+    it = cache.entries.end() - 1;
+  }
+
+  cache.last = &*it;
+  return cache.last->ring.get();
+}
+
+void Logger::drainDeferred() {
+  std::vector<std::shared_ptr<LogRing>> current;
+  {
+    std::unique_lock lock(ringsMutex);
+    current = rings;
+  }
+
+  struct Drained {
+    int64_t timestamp;
+    LoggerLevel level;
+    uint16_t tag;
+    std::string log;
+  };
+  std::vector<Drained> drained;
+
+  for (auto const &ring : current) {
+    ring->drain([&drained](std::span<std::byte const> record) {
+      LogRecordHeader header;
+      std::memcpy(&header, record.data(), sizeof(header));
+
+      drained.push_back({header.timestamp, header.level, header.tag,
+                         header.format(std::string_view(header.formatString, header.formatLength),
+                                       record.subspan(sizeof(header)))});
+    });
+  }
+
+  // Each ring is in order already, interleave the threads by when they logged
+  std::stable_sort(drained.begin(), drained.end(),
+                   [](auto const &a, auto const &b) { return a.timestamp < b.timestamp; });
+
+  for (auto const &log : drained) {
+    loggerCallback.invoke(log.level, std::string(detail::logTagName(log.tag)), log.log);
+  }
+
+  // The thread set abandoned after its last write, so an empty abandoned ring stays empty
+  std::unique_lock lock(ringsMutex);
+  std::erase_if(rings, [](auto const &ring) {
+    return ring->abandoned.load(std::memory_order_acquire) && ring->empty();
+  });
+}
 #ifdef SOCKETLIB_PAPER_LOG
 
 #warning Using paper logger
@@ -26,8 +179,10 @@ void Logger::queueLogInternal(const moodycamel::ProducerToken &producer,
       "[{}] {}", Paper::LogLevel::INF, Paper::sl::current("", "", 0, 0), "SocketLib",
       fmt::make_format_args(tag, log));
 #else
-  while (!this->logQueue.enqueue(producer, {level, tag, log})) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  // Dropped rather than waited on, a socket thread must never stall on logging
+  if (logQueue.size_approx() >= maxQueuedLogs.load(std::memory_order_relaxed) ||
+      !logQueue.enqueue(producer, {level, tag, log})) {
+    droppedLogs.fetch_add(1, std::memory_order_relaxed);
   }
 #endif
 }
@@ -41,8 +196,9 @@ void Logger::queueLogInternal(LoggerLevel level, std::string_view tag,
       "[{}] {}", Paper::LogLevel::INF, Paper::sl::current("", "", 0, 0), "SocketLib",
       fmt::make_format_args(tag, log));
 #else
-  while (!logQueue.enqueue({level, tag, log})) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  if (logQueue.size_approx() >= maxQueuedLogs.load(std::memory_order_relaxed) ||
+      !logQueue.enqueue({level, tag, log})) {
+    droppedLogs.fetch_add(1, std::memory_order_relaxed);
   }
 #endif
 }
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+
+namespace SocketLib::Benchmarks {
+    /// Round trip latency of clients sharing a worker with a client that never reads
+    void slowConsumer();
+
+    /// Allocations and time per Message for payloads that fit inline and ones that don't
+    void messageAllocations();
+
+    /// Mixed size allocations from several threads through operator new and BufferPool
+    void bufferPool();
+
+    /// Cost of one call through a function pointer, the previous shared_ptr to std::function layout and ThinVirtualLayer
+    void delegates();
+
+    /// Time and allocations per error log on the calling thread, formatted there and deferred to the logger thread
+    void logging();
+
+    /// Invokes per second from several threads, with a reader lock and with copy on write snapshots
+    void eventCallbacks();
+
+    /// Time to queue one payload to thousands of clients and until all of them read it
+    void fanOut();
+
+    /// Round trip latency of clients sharing a worker with a client whose listener blocks,
+    /// with listen events run on the I/O thread and dispatched through strands
+    void slowHandler();
+
+    /// Round trip latency while other connections are opened and closed as fast as possible
+    void connectionChurn();
+
+    /// GB/s splitting newline terminated lines, with std::string::find on dequeued copies as the harnesses did,
+    /// with FrameDecoder, and for each byte search on its own
+    void delimiterFraming();
+
+    /// Receive wakeups per large length prefixed frame, with and without SO_RCVLOWAT raised to the missing bytes
+    void frameWakeups();
+
+    /// Time and allocations per message parsing a type and length header, with peek and dequeue as the harnesses did
+    /// and with StreamReader
+    void headerParsing();
+
+    /// Time and allocations per formatted, length prefixed message, through fmt::format and a Message copy as the
+    /// harnesses did and through MessageBuilder
+    void messageBuilder();
+
+    /// Allocations through operator new since startup, counted by AllocationCounter.cpp
+    std::size_t allocationCount();
+}
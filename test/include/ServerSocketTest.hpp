@@ -11,8 +11,12 @@ namespace SocketLib {
         void startTest();
         void connectEvent(SocketLib::Channel& channel, bool connected) const;
         void listenOnEvents(SocketLib::Channel& clientDescriptor, SocketLib::ReadOnlyStreamQueue& incomingQueue) const;
+        void listenOnFrames(SocketLib::Channel& client, std::span<const uint8_t> frame) const;
 
         ServerSocket* serverSocket;
+        bool shardedAccept = false;
+        bool dispatchListenEvents = false;
+        FrameFormat framing = FrameFormat::None;
     };
 }
 
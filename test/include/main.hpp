@@ -1,8 +1,12 @@
 #pragma once
 
 #include "SocketLogger.hpp"
+#include "Framing.hpp"
 
-void startTests(bool server);
+void startTests(bool server, bool shardedAccept = false, bool dispatchListenEvents = false,
+                SocketLib::FrameFormat framing = SocketLib::FrameFormat::None);
+
+void startBenchmarks();
 
 void handleLog(SocketLib::LoggerLevel level, std::string_view tag, std::string_view log);
 
@@ -0,0 +1,41 @@
+#include "Benchmarks.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts every allocation in the process, so benchmarks can report allocations per operation.
+// In its own file so the replacements are never inlined into their callers
+static std::atomic_size_t allocations = 0;
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+std::size_t SocketLib::Benchmarks::allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,959 @@
+#include "main.hpp"
+#include "Benchmarks.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "SocketHandler.hpp"
+#include "BufferPool.hpp"
+#include "ServerSocket.hpp"
+#include "Framing.hpp"
+#include "ByteSearch.hpp"
+#include "StreamReader.hpp"
+#include "MessageBuilder.hpp"
+#include "fmt/format.h"
+
+using namespace SocketLib;
+
+namespace {
+    constexpr uint16_t BENCHMARK_PORT = 3307;
+
+    constinit LogTag BENCHMARK_LOG_TAG{"benchmark"};
+
+    /// Plain blocking client, so only the server is measured
+    int connectClient(int receiveBuffer = 0) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        if (receiveBuffer > 0) {
+            // Before connect, so the advertised window stays small
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+        }
+
+        timeval timeout{.tv_sec = 2, .tv_usec = 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(BENCHMARK_PORT);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    /// Sends a ping and waits for the echo
+    /// \return round trip in microseconds, or a negative value if the echo never came
+    double roundTrip(int fd) {
+        constexpr std::string_view ping = "ping-0123456789\n";
+        char reply[ping.size()];
+
+        auto start = std::chrono::steady_clock::now();
+        if (send(fd, ping.data(), ping.size(), 0) != (long) ping.size()) {
+            return -1;
+        }
+
+        std::size_t received = 0;
+        while (received < ping.size()) {
+            auto count = recv(fd, reply + received, ping.size() - received, 0);
+            if (count <= 0) {
+                return -1;
+            }
+            received += count;
+        }
+
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void printLatencies(std::string_view name, std::vector<int> const &clients, int rounds) {
+        std::vector<double> latencies;
+        int stalled = 0;
+
+        for (int i = 0; i < rounds; i++) {
+            for (int fd: clients) {
+                auto latency = roundTrip(fd);
+                if (latency < 0) {
+                    stalled++;
+                    continue;
+                }
+                latencies.push_back(latency);
+            }
+        }
+
+        if (latencies.empty()) {
+            fmt::print("{:<28} every round trip stalled\n", name);
+            return;
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        fmt::print("{:<28} p50 {:>8.1f}us  p99 {:>8.1f}us  max {:>8.1f}us  stalled {}\n", name,
+                   latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back(),
+                   stalled);
+    }
+
+    thread_local uint64_t callbackSum = 0;
+
+    void addToSum(int value) {
+        callbackSum += value;
+    }
+
+    void addTwiceToSum(int value) {
+        callbackSum += value * 2;
+    }
+}
+
+void Benchmarks::slowConsumer() {
+    constexpr int fastClientCount = 4;
+    constexpr int rounds = 500;
+    // 16MB, far more than the slow client's socket buffers can take
+    constexpr std::size_t floodMessageSize = 64 * 1024;
+    constexpr int floodMessages = 256;
+
+    SocketHandler &socketHandler = SocketHandler::getCommonSocketHandler();
+    auto *serverSocket = socketHandler.createServerSocket(BENCHMARK_PORT);
+
+    // Every channel on one worker, the worst case for a stalled writer
+    serverSocket->workerThreadCount = 1;
+    // Bound what the slow client can pin
+    serverSocket->writeLimits.maxBytes = 4 * 1024 * 1024;
+
+    std::atomic_int unwritable = 0;
+    std::atomic_int dropped = 0;
+    serverSocket->writabilityCallback += [&unwritable](Channel &, bool writable) {
+        if (!writable) {
+            unwritable++;
+        }
+    };
+
+    // Shared, so queueing it 256 times does not copy 16MB
+    std::vector<byte> const floodBytes(floodMessageSize, 'x');
+    Message const flood = Message::makeShared(floodBytes);
+    serverSocket->listenCallback += [&flood, &dropped](Channel &channel, ReadOnlyStreamQueue &incomingQueue) {
+        auto message = incomingQueue.dequeAsMessage();
+
+        if (message.toStringView().starts_with("flood")) {
+            for (int i = 0; i < floodMessages; i++) {
+                if (!channel.queueWrite(flood)) {
+                    dropped++;
+                }
+            }
+            return;
+        }
+
+        channel.queueWrite(message);
+    };
+
+    serverSocket->bindAndListen();
+
+    std::vector<int> fastClients;
+    for (int i = 0; i < fastClientCount; i++) {
+        fastClients.push_back(connectClient());
+    }
+
+    fmt::print("Slow consumer: {} clients echoing, {} rounds each\n", fastClientCount, rounds);
+    printLatencies("no slow client", fastClients, rounds);
+
+    // Never reads, so the server's writes to it back up almost immediately
+    int slowClient = connectClient(4096);
+    send(slowClient, "flood\n", 6, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    printLatencies("saturated slow client", fastClients, rounds);
+    fmt::print("slow client went unwritable {} times, {} of {} flood messages dropped at the 4MB limit\n",
+               unwritable.load(), dropped.load(), floodMessages);
+
+    close(slowClient);
+    for (int fd: fastClients) {
+        close(fd);
+    }
+
+    socketHandler.destroySocket(serverSocket);
+}
+
+void Benchmarks::slowHandler() {
+    constexpr int fastClientCount = 4;
+    constexpr int rounds = 200;
+    // Stands in for a handler waiting on a database or another service
+    constexpr auto handlerDelay = std::chrono::milliseconds(2);
+
+    SocketHandler &socketHandler = SocketHandler::getCommonSocketHandler();
+    fmt::print("Slow handler: {} clients echoing next to one whose listener blocks {}ms, {} callback threads\n",
+               fastClientCount, handlerDelay.count(), socketHandler.getCallbackExecutor().getThreadCount());
+
+    for (bool dispatch: {false, true}) {
+        auto *serverSocket = socketHandler.createServerSocket(BENCHMARK_PORT);
+
+        // Every channel on one worker, so inline listeners hold up each other
+        serverSocket->workerThreadCount = 1;
+        serverSocket->dispatchListenEvents = dispatch;
+        serverSocket->listenCallback += [handlerDelay](Channel &channel, ReadOnlyStreamQueue &incomingQueue) {
+            auto message = incomingQueue.dequeAsMessage();
+
+            if (message.toStringView().starts_with("slow")) {
+                std::this_thread::sleep_for(handlerDelay);
+            }
+            channel.queueWrite(message);
+        };
+        serverSocket->bindAndListen();
+
+        std::vector<int> fastClients;
+        for (int i = 0; i < fastClientCount; i++) {
+            fastClients.push_back(connectClient());
+        }
+
+        // Keeps exactly one slow request in flight
+        std::atomic_bool running = true;
+        int slowClient = connectClient();
+        std::thread slow([&running, slowClient] {
+            char reply[5];
+            while (running && send(slowClient, "slow\n", 5, 0) == 5) {
+                if (recv(slowClient, reply, sizeof(reply), MSG_WAITALL) <= 0) {
+                    break;
+                }
+            }
+        });
+
+        printLatencies(dispatch ? "dispatched through strands" : "on the I/O thread", fastClients, rounds);
+
+        running = false;
+        slow.join();
+        close(slowClient);
+        for (int fd: fastClients) {
+            close(fd);
+        }
+
+        socketHandler.destroySocket(serverSocket);
+    }
+}
+
+void Benchmarks::messageAllocations() {
+    constexpr int iterations = 1000000;
+    // Either side of Message::INLINE_CAPACITY, the larger ones come from the default BufferPool
+    constexpr std::size_t payloadSizes[] = {8, 32, Message::INLINE_CAPACITY, Message::INLINE_CAPACITY + 1, 256};
+
+    fmt::print("Message allocations: {} messages per size, constructed, moved and destroyed\n", iterations);
+
+    std::vector<byte> const payload(256, 'x');
+    for (auto size: payloadSizes) {
+        std::span<const byte> bytes(payload.data(), size);
+
+        auto allocationsBefore = Benchmarks::allocationCount();
+        auto start = std::chrono::steady_clock::now();
+
+        std::size_t checksum = 0;
+        for (int i = 0; i < iterations; i++) {
+            Message message(bytes.data(), bytes.size());
+            Message moved(std::move(message));
+            checksum += moved.data()[i % size];
+        }
+
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        auto allocations = Benchmarks::allocationCount() - allocationsBefore;
+
+        fmt::print("{:>4} bytes ({:<6}) {:>5.2f} allocations/message  {:>6.1f}ns/message  (checksum {})\n", size,
+                   size <= Message::INLINE_CAPACITY ? "inline" : "pooled", (double) allocations / iterations,
+                   elapsed / iterations, checksum);
+    }
+}
+
+void Benchmarks::bufferPool() {
+    constexpr int threadCount = 4;
+    constexpr int iterations = 500000;
+    // Spread over several size classes, like payloads and queue blocks
+    static constexpr std::size_t sizes[] = {100, 300, 1500, 4000, 16 * 1024};
+    // Allocations each thread keeps alive, so frees don't always hit the block just allocated
+    constexpr std::size_t window = 64;
+
+    auto run = [&](std::string_view name, BufferAllocator &allocator) {
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back([&allocator, t] {
+                std::vector<std::pair<byte *, std::size_t>> live(window, {nullptr, 0});
+
+                for (int i = 0; i < iterations; i++) {
+                    auto &slot = live[i % window];
+                    allocator.deallocate(slot.first, slot.second);
+
+                    auto size = sizes[(i + t) % std::size(sizes)];
+                    slot = {allocator.allocate(size), size};
+                    slot.first[0] = (byte) i;
+                }
+
+                for (auto [data, size]: live) {
+                    allocator.deallocate(data, size);
+                }
+            });
+        }
+
+        for (auto &thread: threads) {
+            thread.join();
+        }
+
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        fmt::print("{:<28} {:>6.1f}ns per allocate/deallocate pair\n", name, elapsed / (threadCount * iterations));
+    };
+
+    fmt::print("Buffer pool: {} threads, {} allocations each\n", threadCount, iterations);
+
+    // Every operator new counts allocations here, but that's the same for all three
+    run("operator new", BufferAllocator::heap());
+
+    BufferPool pool;
+    run("BufferPool", pool);
+
+    std::vector<byte> arenaMemory(32 * 1024 * 1024);
+    ArenaAllocator arena(arenaMemory);
+    BufferPool arenaPool(arena, 64 * 1024);
+    run("BufferPool over 32MB arena", arenaPool);
+
+    auto stats = pool.getStats();
+    fmt::print("pool: {} slabs ({}KB), {} refills, {} flushes, {} free blocks\n", stats.slabs, stats.slabBytes / 1024,
+               stats.refills, stats.flushes, stats.freeBlocks);
+    fmt::print("arena pool: {}KB of the arena used\n", arena.used() / 1024);
+}
+
+void Benchmarks::delegates() {
+    constexpr int iterations = 50000000;
+
+    // Two targets called alternately, so the compiler can't resolve the call
+    auto run = [&]<typename Callable>(std::string_view name, std::vector<Callable> const &targets) {
+        callbackSum = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < iterations; i++) {
+            auto const &target = targets[i & 1];
+            if constexpr (requires { (*target)(1); }) {
+                (*target)(1);
+            } else {
+                target(1);
+            }
+        }
+
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        fmt::print("{:<36} {:>5.2f}ns per call  (sum {})\n", name, elapsed / iterations, callbackSum);
+    };
+
+    fmt::print("Delegates: {} calls\n", iterations);
+
+    std::vector<void (*)(int)> pointers{addToSum, addTwiceToSum};
+    run("function pointer", pointers);
+
+    // What ThinVirtualLayer used to hold
+    std::vector<std::shared_ptr<std::function<void(int)>>> wrapped{
+            std::make_shared<std::function<void(int)>>(addToSum),
+            std::make_shared<std::function<void(int)>>(addTwiceToSum)
+    };
+    run("shared_ptr to std::function", wrapped);
+
+    using Delegate = ThinVirtualLayer<void(void *, int)>;
+    std::vector<Delegate> delegates{Delegate(addToSum), Delegate(addTwiceToSum)};
+    run("ThinVirtualLayer", delegates);
+
+    // The same work as the functions above, through a capture
+    auto const multiplyBy = [](int factor) {
+        return [factor](int value) { callbackSum += value * factor; };
+    };
+
+    std::vector<std::shared_ptr<std::function<void(int)>>> wrappedLambdas{
+            std::make_shared<std::function<void(int)>>(multiplyBy(1)),
+            std::make_shared<std::function<void(int)>>(multiplyBy(2))
+    };
+    run("shared_ptr to std::function, lambda", wrappedLambdas);
+
+    std::vector<Delegate> lambdas{Delegate(multiplyBy(1)), Delegate(multiplyBy(2))};
+    run("ThinVirtualLayer, lambda", lambdas);
+}
+
+void Benchmarks::logging() {
+    // Drained between batches, the way the logger thread keeps up
+    constexpr int batch = 256;
+    constexpr int iterations = batch * 1000;
+
+    auto run = [&](std::string_view name, bool defer, auto &&log) {
+        Logger logger;
+        logger.DebugEnabled = true;
+        logger.deferFormatting = defer;
+        // Nothing drains the queue here, keep every formatted log
+        logger.maxQueuedLogs = iterations;
+
+        std::size_t delivered = 0;
+        logger.loggerCallback += [&delivered](LoggerLevel, std::string const &, std::string const &) {
+            delivered++;
+        };
+
+        double elapsed = 0;
+        std::size_t allocations = 0;
+        for (int i = 0; i < iterations; i += batch) {
+            auto allocationsBefore = Benchmarks::allocationCount();
+            auto start = std::chrono::steady_clock::now();
+
+            for (int j = 0; j < batch; j++) {
+                log(logger, i + j);
+            }
+
+            elapsed += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            allocations += Benchmarks::allocationCount() - allocationsBefore;
+
+            logger.drainDeferred();
+        }
+
+        fmt::print("{:<24} {:>6.1f}ns per log  {:>5.2f} allocations/log  (delivered {}, dropped {})\n", name,
+                   elapsed / iterations, (double) allocations / iterations, delivered, logger.getDroppedLogs());
+    };
+
+    auto errorLog = [](Logger &logger, int i) {
+        logger.fmtLog<LoggerLevel::ERROR>(BENCHMARK_LOG_TAG,
+                                          "Closing socket {} because it has crashed fatally while reading: {}", i,
+                                          "Connection reset by peer");
+    };
+
+    fmt::print("Logging: {} error logs with two arguments from one thread\n", iterations);
+
+    run("formatted", false, errorLog);
+    run("deferred", true, errorLog);
+
+    run("below tag level", false, [](Logger &logger, int i) {
+        if (i == 0) {
+            logger.setLevel("benchmark", LoggerLevel::ERROR);
+        }
+        logger.fmtLog<LoggerLevel::WARN>(BENCHMARK_LOG_TAG, "Write queue of {} is full, dropping message", i);
+    });
+
+    // Looked up by content on every call instead of once per LogTag
+    run("below level, string tag", false, [](Logger &logger, int i) {
+        if (i == 0) {
+            logger.setLevel("benchmark", LoggerLevel::ERROR);
+        }
+        logger.fmtLog<LoggerLevel::WARN>("benchmark", "Write queue of {} is full, dropping message", i);
+    });
+
+    RateLimit limit(10, 20);
+    run("rate limited", false, [&limit](Logger &logger, int i) {
+        logger.fmtLog<LoggerLevel::ERROR>(limit, BENCHMARK_LOG_TAG, "Write queue of {} is full, dropping message", i);
+    });
+}
+
+void Benchmarks::delimiterFraming() {
+    constexpr std::size_t totalBytes = 32 * 1024 * 1024;
+    // What one read hands over
+    constexpr std::size_t readSize = 64 * 1024;
+
+    std::vector<uint8_t> stream;
+    stream.reserve(totalBytes + 256);
+    uint32_t seed = 1;
+    while (stream.size() < totalBytes) {
+        seed = seed * 1664525 + 1013904223;
+        auto const length = 16 + (seed >> 8) % 240;
+        for (std::size_t i = 0; i < length; i++) {
+            stream.push_back('a' + (seed + i) % 26);
+        }
+        stream.push_back('\n');
+    }
+
+    auto report = [&](std::string_view name, auto &&split) {
+        auto start = std::chrono::steady_clock::now();
+        std::size_t lines = split();
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        fmt::print("{:<28} {:>6.2f} GB/s  ({} lines)\n", name, (double) stream.size() / elapsed, lines);
+    };
+
+    fmt::print("Delimiter framing: {} MB of lines, {} KB per read\n", stream.size() / (1024 * 1024), readSize / 1024);
+
+    report("string::find on copies", [&] {
+        StreamQueue queue;
+        std::string pending;
+        std::size_t lines = 0;
+
+        for (std::size_t offset = 0; offset < stream.size(); offset += readSize) {
+            queue.enqueue(std::span(stream).subspan(offset, std::min(readSize, stream.size() - offset)));
+
+            pending += queue.dequeAsMessage().toString();
+            std::size_t lineStart = 0;
+            for (auto end = pending.find('\n'); end != std::string::npos; end = pending.find('\n', lineStart)) {
+                auto line = pending.substr(lineStart, end - lineStart);
+                lines += !line.empty();
+                lineStart = end + 1;
+            }
+            pending.erase(0, lineStart);
+        }
+        return lines;
+    });
+
+    report("FrameDecoder", [&] {
+        FrameDecoder decoder({FrameFormat::Delimited});
+        StreamQueue pending;
+        std::size_t lines = 0;
+
+        for (std::size_t offset = 0; offset < stream.size(); offset += readSize) {
+            decoder.decode(pending, std::span(stream).subspan(offset, std::min(readSize, stream.size() - offset)),
+                           [&lines](std::span<const uint8_t> line) {
+                lines += !line.empty();
+            });
+        }
+        return lines;
+    });
+
+    // Search alone, counting every delimiter
+    auto search = [&](std::string_view name, Utils::ByteSearch::FindFn find) {
+        if (find == nullptr) {
+            fmt::print("{:<28} unsupported\n", name);
+            return;
+        }
+
+        report(name, [&] {
+            std::size_t lines = 0;
+            for (std::size_t offset = 0;;) {
+                auto const found = find(stream.data() + offset, stream.size() - offset, '\n');
+                if (found == Utils::BYTE_NOT_FOUND) {
+                    return lines;
+                }
+                lines++;
+                offset += found + 1;
+            }
+        });
+    };
+
+    search("byte loop", [](uint8_t const *data, std::size_t size, uint8_t value) {
+        for (std::size_t i = 0; i < size; i++) {
+            if (data[i] == value) {
+                return i;
+            }
+        }
+        return Utils::BYTE_NOT_FOUND;
+    });
+    search("memchr", Utils::ByteSearch::findPortable);
+    search("SSE2", Utils::ByteSearch::sse2());
+    search("AVX2", Utils::ByteSearch::avx2());
+    search("findByte", [](uint8_t const *data, std::size_t size, uint8_t value) {
+        return Utils::findByte({data, size}, value);
+    });
+}
+
+void Benchmarks::eventCallbacks() {
+    constexpr int threadCount = 4;
+    constexpr int iterations = 2000000;
+
+    auto run = [&]<typename Callback>(std::string_view name, Callback &callback) {
+        std::atomic_uint64_t total = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back([&callback, &total] {
+                callbackSum = 0;
+                for (int i = 0; i < iterations; i++) {
+                    callback.invoke(1);
+                }
+                total += callbackSum;
+            });
+        }
+
+        for (auto &thread: threads) {
+            thread.join();
+        }
+
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        fmt::print("{:<28} {:>6.1f}ns per invoke  (sum {})\n", name, elapsed / (threadCount * iterations),
+                   total.load());
+    };
+
+    fmt::print("Event callbacks: {} threads, {} invokes each of two subscribers\n", threadCount, iterations);
+
+    Utils::EventCallback<int> locked;
+    locked += addToSum;
+    locked += addTwiceToSum;
+    run("shared_mutex", locked);
+
+    Utils::SnapshotEventCallback<int> snapshot;
+    snapshot += addToSum;
+    snapshot += addTwiceToSum;
+    run("copy on write snapshot", snapshot);
+}
+
+void Benchmarks::fanOut() {
+    constexpr int clientCount = 2000;
+    constexpr int rounds = 20;
+    constexpr std::size_t payloadSize = 256;
+
+    SocketHandler &socketHandler = SocketHandler::getCommonSocketHandler();
+    auto *serverSocket = socketHandler.createServerSocket(BENCHMARK_PORT);
+    serverSocket->bindAndListen();
+
+    std::vector<int> clients;
+    for (int i = 0; i < clientCount; i++) {
+        clients.push_back(connectClient());
+    }
+
+    while (serverSocket->getClientCount() < clientCount) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Every other client joins the group, matched to the server side channel by port
+    std::unordered_map<in_port_t, int> channelsByPort;
+    serverSocket->forEachClient([&](Channel &channel) {
+        auto peer = serverSocket->getPeerName(channel.clientDescriptor);
+        channelsByPort[reinterpret_cast<sockaddr_in &>(peer).sin_port] = channel.clientDescriptor;
+    });
+
+    std::vector<int> members;
+    std::vector<int> memberClients;
+    for (std::size_t i = 0; i < clients.size(); i += 2) {
+        sockaddr_in address{};
+        socklen_t length = sizeof(address);
+        getsockname(clients[i], reinterpret_cast<sockaddr *>(&address), &length);
+
+        members.push_back(channelsByPort.at(address.sin_port));
+        memberClients.push_back(clients[i]);
+    }
+    for (int fd: members) {
+        serverSocket->joinGroup("half", fd);
+    }
+
+    std::vector<byte> const payload(payloadSize, 'f');
+
+    // CPU time of the calling thread, workers flushing on the same core don't count against queueing
+    auto threadTime = [] {
+        timespec time{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+    };
+
+    /// Times queueing one payload to the recipients, then waits until every recipient read it
+    auto run = [&](std::string_view name, std::vector<int> const &recipients, auto &&send) {
+        std::vector<double> queueTimes;
+        std::vector<double> deliveryTimes;
+        char reply[payloadSize];
+
+        for (int round = 0; round < rounds; round++) {
+            auto start = std::chrono::steady_clock::now();
+            auto startCpu = threadTime();
+            send();
+            queueTimes.push_back(threadTime() - startCpu);
+
+            std::size_t received = 0;
+            for (int fd: recipients) {
+                if (recv(fd, reply, sizeof(reply), MSG_WAITALL) == (long) sizeof(reply)) {
+                    received++;
+                }
+            }
+
+            deliveryTimes.push_back(
+                    std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+            if (received < recipients.size()) {
+                fmt::print("{:<28} only {} of {} clients received the payload\n", name, received, recipients.size());
+                return;
+            }
+        }
+
+        std::sort(queueTimes.begin(), queueTimes.end());
+        std::sort(deliveryTimes.begin(), deliveryTimes.end());
+        fmt::print("{:<28} queued in p50 {:>8.1f}us CPU  every recipient read it in p50 {:>8.1f}us\n", name,
+                   queueTimes[rounds / 2], deliveryTimes[rounds / 2]);
+    };
+
+    fmt::print("Fan out: {} byte payload to {} clients, {} rounds\n", payloadSize, clientCount, rounds);
+
+    run("queueWrite per client", clients, [&] {
+        Message message(payload.data(), payload.size());
+        serverSocket->forEachClient([&message](Channel &channel) {
+            channel.queueWrite(message);
+        });
+    });
+
+    run("broadcast", clients, [&] {
+        serverSocket->broadcast(Message(payload.data(), payload.size()));
+    });
+
+    run("multicast to half", memberClients, [&] {
+        serverSocket->multicast("half", Message(payload.data(), payload.size()));
+    });
+
+    for (int fd: clients) {
+        close(fd);
+    }
+
+    socketHandler.destroySocket(serverSocket);
+}
+
+void Benchmarks::connectionChurn() {
+    constexpr int clientCount = 4;
+    constexpr int rounds = 500;
+
+    SocketHandler &socketHandler = SocketHandler::getCommonSocketHandler();
+    auto *serverSocket = socketHandler.createServerSocket(BENCHMARK_PORT);
+    serverSocket->listenCallback += [](Channel &channel, ReadOnlyStreamQueue &incomingQueue) {
+        channel.queueWrite(incomingQueue.dequeAsMessage());
+    };
+
+    // Handles of every closed connection, descriptors are reused by the next accepts but handles aren't
+    std::mutex closedMutex;
+    std::vector<ChannelHandle> closedHandles;
+    serverSocket->connectCallback += [&](Channel &channel, bool connected) {
+        if (!connected) {
+            std::unique_lock lock(closedMutex);
+            closedHandles.push_back(channel.getHandle());
+        }
+    };
+    serverSocket->bindAndListen();
+
+    std::vector<int> clients;
+    for (int i = 0; i < clientCount; i++) {
+        clients.push_back(connectClient());
+    }
+
+    fmt::print("Connection churn: {} clients echoing, {} rounds each\n", clientCount, rounds);
+    printLatencies("no churn", clients, rounds);
+
+    // Connects and drops as fast as it can, every accept and close touches the channel tables
+    std::atomic_bool churning = true;
+    std::atomic_int churned = 0;
+    std::thread churn([&churning, &churned] {
+        while (churning) {
+            int fd = connectClient();
+            if (fd != -1) {
+                close(fd);
+                churned++;
+            }
+        }
+    });
+
+    printLatencies("accept/close storm", clients, rounds);
+    churning = false;
+    churn.join();
+    fmt::print("{} connections opened and closed meanwhile\n", churned.load());
+
+    std::size_t staleWrites = 0;
+    {
+        std::unique_lock lock(closedMutex);
+        for (auto handle: closedHandles) {
+            staleWrites += serverSocket->write(handle, Message("stale\n"));
+        }
+        fmt::print("{} writes through {} stale handles reached a channel\n", staleWrites, closedHandles.size());
+    }
+
+    // Every connect and disconnect callback of the storm went through the shared executor
+    auto const stats = socketHandler.getCallbackExecutor().getStats();
+    fmt::print("callback executor: {} threads, {} tasks run, at most {} queued, {} stolen, {} ran inline\n",
+               socketHandler.getCallbackExecutor().getThreadCount(), stats.executed, stats.maxQueued, stats.stolen,
+               stats.ranInline);
+
+    for (int fd: clients) {
+        close(fd);
+    }
+
+    socketHandler.destroySocket(serverSocket);
+}
+
+void Benchmarks::frameWakeups() {
+    constexpr int frameCount = 64;
+    constexpr std::size_t frameSize = 1024 * 1024;
+    constexpr std::size_t segmentSize = 16 * 1024;
+
+    fmt::print("Frame wakeups: {} frames of {} KB, U32BE prefixed, sent {} KB at a time\n", frameCount,
+               frameSize / 1024, segmentSize / 1024);
+
+    std::vector<uint8_t> frame(4 + frameSize, 'x');
+    frame[0] = frameSize >> 24;
+    frame[1] = (frameSize >> 16) & 0xFF;
+    frame[2] = (frameSize >> 8) & 0xFF;
+    frame[3] = frameSize & 0xFF;
+
+    SocketHandler &socketHandler = SocketHandler::getCommonSocketHandler();
+    for (bool lowWatermark: {false, true}) {
+        auto *serverSocket = socketHandler.createServerSocket(BENCHMARK_PORT);
+        serverSocket->framing.format = FrameFormat::U32BE;
+        serverSocket->framing.maxFrameSize = 4 * 1024 * 1024;
+        serverSocket->framing.receiveLowWatermark = lowWatermark;
+        serverSocket->bufferSize = 64 * 1024;
+
+        std::atomic_int frames = 0;
+        std::atomic_uint64_t receiveEvents = 0;
+        serverSocket->frameCallback += [&](Channel &channel, std::span<const uint8_t>) {
+            receiveEvents = channel.getReceiveEvents();
+            frames++;
+        };
+        serverSocket->bindAndListen();
+
+        int fd = connectClient();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frameCount; i++) {
+            // Trickled like segments off a real link, a sender faster than the loop never lets it go idle
+            for (std::size_t sent = 0; sent < frame.size();) {
+                auto count = send(fd, frame.data() + sent, std::min(segmentSize, frame.size() - sent), 0);
+                if (count <= 0) {
+                    break;
+                }
+                sent += count;
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+        }
+
+        while (frames < frameCount && std::chrono::steady_clock::now() - start < std::chrono::seconds(30)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        fmt::print("{:<28} {:>8.1f} wakeups per frame  {:>8.1f}ms  {} frames\n",
+                   lowWatermark ? "SO_RCVLOWAT" : "default low watermark",
+                   static_cast<double>(receiveEvents.load()) / std::max(frames.load(), 1), elapsed, frames.load());
+
+        close(fd);
+        socketHandler.destroySocket(serverSocket);
+    }
+}
+
+void Benchmarks::headerParsing() {
+    constexpr int iterations = 200000;
+    constexpr std::size_t payloadSize = 24;
+    // Refilled in batches so messages land at every offset of the ring, some straddling its end
+    constexpr int batch = 100;
+
+    fmt::print("Header parsing: {} messages of a u8 type, u32 big endian length and {} byte payload\n", iterations,
+               payloadSize);
+
+    std::vector<uint8_t> message = {7, 0, 0, 0, payloadSize};
+    message.resize(5 + payloadSize, 'x');
+
+    std::vector<uint8_t> stream;
+    for (int i = 0; i < batch; i++) {
+        stream.insert(stream.end(), message.begin(), message.end());
+    }
+    // Odd sized, so batches don't line up with the ring
+    stream.push_back(0);
+
+    auto run = [&](std::string_view name, auto &&parse) {
+        StreamQueue queue;
+        std::size_t checksum = 0;
+        auto allocationsBefore = Benchmarks::allocationCount();
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < iterations / batch; i++) {
+            queue.enqueue(stream);
+            for (int j = 0; j < batch; j++) {
+                checksum += parse(queue);
+            }
+            queue.consume(1);
+        }
+
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        auto allocations = Benchmarks::allocationCount() - allocationsBefore;
+        fmt::print("{:<28} {:>5.2f} allocations/message  {:>6.1f}ns/message  (checksum {})\n", name,
+                   (double) allocations / iterations, elapsed / iterations, checksum);
+    };
+
+    run("peek and dequeue", [](StreamQueue &queue) -> std::size_t {
+        auto header = queue.peek(5);
+        if (header.size() < 5) {
+            return 0;
+        }
+
+        uint32_t length = (header[1] << 24) | (header[2] << 16) | (header[3] << 8) | header[4];
+        if (queue.queueSize() < 5 + length) {
+            return 0;
+        }
+
+        queue.consume(5);
+        auto payload = queue.dequeue(length);
+        return header[0] + payload.size() + payload.back();
+    });
+
+    run("StreamReader", [](StreamQueue &queue) -> std::size_t {
+        StreamReader reader(queue);
+        auto type = reader.readU8();
+        auto length = reader.readU32BE();
+        if (!type || !length) {
+            return 0;
+        }
+
+        auto payload = reader.readBytes(*length);
+        if (!payload) {
+            return 0;
+        }
+
+        auto const &last = (*payload)[1].empty() ? (*payload)[0] : (*payload)[1];
+        reader.commit();
+        return *type + *length + last.back();
+    });
+}
+
+void Benchmarks::messageBuilder() {
+    constexpr int iterations = 500000;
+
+    fmt::print("Message building: {} messages of a u16 length prefix and a formatted line\n", iterations);
+
+    std::string const line(100, 'x');
+    FramingOptions const framing{FrameFormat::U16BE};
+
+    auto run = [&](std::string_view name, auto &&build) {
+        std::size_t checksum = 0;
+        auto allocationsBefore = Benchmarks::allocationCount();
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < iterations; i++) {
+            Message message = build(i);
+            checksum += message.length();
+        }
+
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        auto allocations = Benchmarks::allocationCount() - allocationsBefore;
+        fmt::print("{:<28} {:>5.2f} allocations/message  {:>6.1f}ns/message  (checksum {})\n", name,
+                   (double) allocations / iterations, elapsed / iterations, checksum);
+    };
+
+    run("fmt::format and copy", [&](int i) {
+        auto text = fmt::format("Client {}: {}\n", i, line);
+
+        Message message(text.size() + 2);
+        message.data()[0] = static_cast<byte>(text.size() >> 8);
+        message.data()[1] = static_cast<byte>(text.size());
+        std::copy(text.begin(), text.end(), message.data() + 2);
+        return message;
+    });
+
+    run("MessageBuilder", [&](int i) {
+        MessageBuilder builder;
+        builder.format("Client {}: {}\n", i, line);
+        return builder.build(framing);
+    });
+}
+
+void startBenchmarks() {
+    // Blocking handlers need threads to spread over even on small machines
+    auto &socketHandler = SocketHandler::getCommonSocketHandler();
+    socketHandler.callbackThreadCount = std::max(std::thread::hardware_concurrency(), 4u);
+
+    Benchmarks::messageAllocations();
+    Benchmarks::messageBuilder();
+    Benchmarks::bufferPool();
+    Benchmarks::delegates();
+    Benchmarks::logging();
+    Benchmarks::headerParsing();
+    Benchmarks::delimiterFraming();
+    Benchmarks::frameWakeups();
+    Benchmarks::eventCallbacks();
+    Benchmarks::fanOut();
+    Benchmarks::connectionChurn();
+    Benchmarks::slowConsumer();
+    Benchmarks::slowHandler();
+}
@@ -9,8 +9,9 @@
 
 #include "SocketHandler.hpp"
 #include "SocketLogger.hpp"
+#include "MessageBuilder.hpp"
 
-constexpr static const std::string_view TEST_LOG_TAG = "ClientSocketTest";
+constinit static SocketLib::LogTag TEST_LOG_TAG{"ClientSocketTest"};
 
 #define log(level, ...) getLogger().fmtLog<level>(TEST_LOG_TAG, __VA_ARGS__)
 
@@ -87,9 +88,10 @@ void ClientSocketTest::listenOnEvents(Channel& client, SocketLib::ReadOnlyStream
         return;
     }
 
-    // Construct message
-    Message constructedMessage(fmt::format("Client {}: {}", client.clientDescriptor, msgStr));
+    // Construct message, formatted straight into the buffer that gets queued
+    MessageBuilder builder;
+    builder.format("Client {}: {}", client.clientDescriptor, msgStr);
 
     // Forward message to other clients if any
-    clientSocket->write(constructedMessage);
+    clientSocket->write(builder.build());
 }
@@ -5,19 +5,22 @@
 
 #include "SocketHandler.hpp"
 #include "SocketLogger.hpp"
+#include "MessageBuilder.hpp"
 
-constexpr static const std::string_view TEST_LOG_TAG = "ServerSocketTest";
+constinit static SocketLib::LogTag TEST_LOG_TAG{"ServerSocketTest"};
 
 #define log(level, ...) getLogger().fmtLog<level>(TEST_LOG_TAG, __VA_ARGS__)
 
 using namespace SocketLib;
 
 void SocketLib::ServerSocketTest::connectEvent(Channel& channel, bool connected) const {
-    log(LoggerLevel::INFO, "Connected {} status: {}", channel.clientDescriptor, connected ? "true" : "false");
+    log(LoggerLevel::INFO, "Connected {} (handle {:#x}) status: {}", channel.clientDescriptor,
+        channel.getHandle().value, connected ? "true" : "false");
 
 
-    if (connected) {
-        channel.queueWrite(Message("hi!\n"));
+    // The handle stays safe to use even if the client disconnects meanwhile
+    if (connected && !serverSocket->write(channel.getHandle(), Message("hi!\n"))) {
+        log(LoggerLevel::INFO, "Client {} left before the greeting", channel.clientDescriptor);
     }
 }
 
@@ -26,6 +29,9 @@ void SocketLib::ServerSocketTest::startTest() {
     SocketHandler& socketHandler = SocketHandler::getCommonSocketHandler();
 
     serverSocket = socketHandler.createServerSocket(3306);
+    serverSocket->shardedAccept = shardedAccept;
+    serverSocket->dispatchListenEvents = dispatchListenEvents;
+    serverSocket->framing.format = framing;
     serverSocket->bindAndListen();
     log(LoggerLevel::INFO, "Started server");
 
@@ -39,6 +45,10 @@ void SocketLib::ServerSocketTest::startTest() {
         listenOnEvents(client, incomingQueue);
     };
 
+    serverSocket.frameCallback += [this](Channel& client, std::span<const uint8_t> frame){
+        listenOnFrames(client, frame);
+    };
+
     log(LoggerLevel::INFO, "Listening server fully started up");
 
     // This is only to keep the test running.
@@ -69,17 +79,41 @@ void ServerSocketTest::listenOnEvents(Channel& client, SocketLib::ReadOnlyStream
         return;
     }
 
-    // Construct message
-    Message constructedMessage(fmt::format("Client {}: {}", client.clientDescriptor, msgStr));
+    // Construct message, formatted straight into the buffer that gets queued
+    MessageBuilder builder;
+    builder.format("Client {}: {}", client.clientDescriptor, msgStr);
 
     // Forward message to other clients if any
-    if (serverSocket->getClients().size() > 1) {
-        for (auto& [id, client2]: serverSocket->getClients()) {
-            if (client.clientDescriptor == client2->clientDescriptor)
-                continue;
+    serverSocket->broadcast(builder.build(), [&](Channel& client2) {
+        return client.getHandle() != client2.getHandle();
+    });
+}
 
+void ServerSocketTest::listenOnFrames(Channel& client, std::span<const uint8_t> frame) const {
+    log(LoggerLevel::DEBUG_LEVEL, "Received frame of {} bytes", frame.size());
 
-            client2->queueWrite(constructedMessage);
+    if (framing == FrameFormat::Delimited) {
+        std::string_view const line(reinterpret_cast<char const*>(frame.data()), frame.size());
+        if (line == "stop") {
+            log(LoggerLevel::INFO, "Stopping server now!");
+            serverSocket->notifyStop();
+            return;
         }
+
+        MessageBuilder builder;
+        builder.format("Client {}: {}", client.clientDescriptor, line);
+
+        serverSocket->broadcast(builder.build(serverSocket->framing), [&](Channel& client2) {
+            return client.getHandle() != client2.getHandle();
+        });
+        return;
     }
+
+    // Relayed with the same length prefix in front
+    MessageBuilder builder(frame.size() + 16);
+    builder.writeBytes(frame);
+
+    serverSocket->broadcast(builder.build(serverSocket->framing), [&](Channel& client2) {
+        return client.getHandle() != client2.getHandle();
+    });
 }
@@ -28,8 +28,32 @@ int main(int argc, char *argv[]) {
     try {
         std::span<char*> args(argv, argc);
 
+        if (std::any_of(args.begin(), args.end(), [](auto const& a) {return std::string_view(a) == "uring"; })) {
+            SocketHandler::getCommonSocketHandler().ioBackend = IoBackend::IoUring;
+        }
+
+        if (std::any_of(args.begin(), args.end(), [](auto const& a) {return std::string_view(a) == "deferlog"; })) {
+            SocketHandler::getCommonSocketHandler().getLogger().deferFormatting = true;
+        }
+
+        bool shardedAccept = std::any_of(args.begin(), args.end(), [](auto const& a) {return std::string_view(a) == "sharded"; });
+        bool dispatchListenEvents = std::any_of(args.begin(), args.end(), [](auto const& a) {return std::string_view(a) == "dispatch"; });
+        // Relays frames with a 2 byte big endian length, or lines, instead of raw reads
+        auto framing = FrameFormat::None;
+        if (std::any_of(args.begin(), args.end(), [](auto const& a) {return std::string_view(a) == "framed"; })) {
+            framing = FrameFormat::U16BE;
+        } else if (std::any_of(args.begin(), args.end(), [](auto const& a) {return std::string_view(a) == "lines"; })) {
+            framing = FrameFormat::Delimited;
+        }
+
+        if (std::any_of(args.begin(), args.end(), [](auto const& a) {return std::string_view(a) == "bench"; })) {
+            startBenchmarks();
+            return 0;
+        }
+
         std::cout << "Starting tests" << std::endl;
-        startTests(!std::any_of(args.begin(), args.end(), [](auto const& a) {return a == "client"; }));
+        startTests(!std::any_of(args.begin(), args.end(), [](auto const& a) {return a == "client"; }), shardedAccept,
+                   dispatchListenEvents, framing);
         std::cout << "Finished tests" << std::endl;
     } catch (std::exception& e) {
         std::cout << "Test failed due to: " << e.what() << std::endl;
@@ -46,13 +70,16 @@ void handleLog(LoggerLevel level, std::string_view const tag, std::string_view c
 }
 #endif
 
-void startTests(bool server) {
+void startTests(bool server, bool shardedAccept, bool dispatchListenEvents, FrameFormat framing) {
     // Subscribe to logger
     SocketHandler::getCommonSocketHandler().getLogger().loggerCallback += handleLog;
 
     if (server) {
         std::cout << "Server test " << std::endl;
         ServerSocketTest serverSocketTest{};
+        serverSocketTest.shardedAccept = shardedAccept;
+        serverSocketTest.dispatchListenEvents = dispatchListenEvents;
+        serverSocketTest.framing = framing;
         serverSocketTest.startTest();
     } else {
         std::cout << "Client test " << std::endl;